@@ -0,0 +1,288 @@
+//******************************************************************************
+// Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+//                    - Helmholtz-Institut Mainz
+//
+// This file is part of devGpio
+//
+// devGpio is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// devGpio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// version 1.0.0; Aug 13, 2015
+//
+//******************************************************************************
+
+//! @file GpioCoincidence.cpp
+//! @brief Implementation of coincidence and sequence detection
+
+//_____ I N C L U D E S ________________________________________________________
+
+// ANSI C/C++ includes
+#include <cstdlib>
+#include <iostream>
+
+// EPICS includes
+
+// local includes
+#include "devGpio.h"
+#include "GpioCoincidence.hpp"
+#include "GpioIntHandler.hpp"
+#include "GpioReflex.hpp"
+
+//_____ D E F I N I T I O N S __________________________________________________
+
+//_____ G L O B A L S __________________________________________________________
+
+//_____ L O C A L S ____________________________________________________________
+
+//_____ F U N C T I O N S ______________________________________________________
+
+//------------------------------------------------------------------------------
+//! @brief   Standard Constructor
+//------------------------------------------------------------------------------
+GpioCoincidence::GpioCoincidence()
+  : _resolved( false )
+{}
+
+//------------------------------------------------------------------------------
+//! @brief   Standard Destructor
+//------------------------------------------------------------------------------
+GpioCoincidence::~GpioCoincidence() {
+  for( auto r : _rules ) delete r;
+  _rules.clear();
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Add a new rule
+//!
+//! Inputs are names of records, optionally followed by ".<N>" to select the
+//! N-th GPIO of the record. The rising edge is used, unless the name is
+//! preceded by "!" to select the falling edge.
+//!
+//! @param   [in]  name       Name of the rule, used in the INP field of records
+//! @param   [in]  first      First input
+//! @param   [in]  second     Second input
+//! @param   [in]  window_us  Maximum time between both edges in microseconds
+//! @param   [in]  ordered    The first input has to fire before the second one
+//!
+//! @return  false in case of an error
+//------------------------------------------------------------------------------
+bool GpioCoincidence::add( std::string const& name, std::string const& first, std::string const& second,
+                           double window_us, bool ordered ) {
+  if( _resolved ) {
+    std::cerr << "GpioCoincidence: Rules have to be added before iocInit" << std::endl;
+    return false;
+  }
+  if( find( name ) ) {
+    std::cerr << "GpioCoincidence: Rule " << name << " already defined" << std::endl;
+    return false;
+  }
+  if( first.empty() || second.empty() || first == second || 0. >= window_us ) {
+    std::cerr << "GpioCoincidence: " << name << ": Invalid inputs or window" << std::endl;
+    return false;
+  }
+
+  rule_t *prule = new rule_t;
+  prule->name = name;
+  std::string const* names[2] = { &first, &second };
+  for( int k = 0; k < 2; ++k ) {
+    input_t& in = prule->inputs[k];
+    bool falling = ( '!' == (*names[k])[0] );
+    in.name = falling ? names[k]->substr( 1 ) : *names[k];
+    in.id = falling ? GPIO_V2_LINE_EVENT_FALLING_EDGE : GPIO_V2_LINE_EVENT_RISING_EDGE;
+    in.pinfo = nullptr;
+    in.offset = 0;
+    in.last_ns = 0;
+  }
+  prule->window_ns = (epicsUInt64)( window_us * 1e3 );
+  prule->ordered = ordered;
+  prule->ncoinc = 0;
+  prule->nviolations = 0;
+  prule->delta_ns = 0;
+  prule->inorder = 0;
+  scanIoInit( &prule->ioscanpvt );
+
+  _rules.push_back( prule );
+  return true;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Find a rule by its name
+//!
+//! @param   [in]  name  Name of the rule
+//!
+//! @return  Address of the rule, nullptr if not found
+//------------------------------------------------------------------------------
+GpioCoincidence::rule_t* GpioCoincidence::find( std::string const& name ) const {
+  for( auto r : _rules ) {
+    if( r->name == name ) return r;
+  }
+  return nullptr;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Resolve the line of an input
+//!
+//! @param   [in]  pin   Address of the input
+//! @param   [in]  pool  Address of the pool of private device data
+//! @param   [in]  used  Number of used entries in the pool
+//!
+//! @return  false in case of an error
+//------------------------------------------------------------------------------
+bool GpioCoincidence::resolveInput( input_t* pin, devGpio_info_t* pool, epicsUInt32 used ) {
+  epicsUInt64 mask = 0;
+  devGpio_info_t *pinfo = GpioReflex::lookup( pin->name, &mask, pool, used );
+  if( !pinfo ) return false;
+
+  epicsUInt64 edge = ( GPIO_V2_LINE_EVENT_RISING_EDGE == pin->id ) ? GPIO_V2_LINE_FLAG_EDGE_RISING
+                                                                   : GPIO_V2_LINE_FLAG_EDGE_FALLING;
+  if( !( pinfo->cold->flags & edge ) ) {
+    std::cerr << "GpioCoincidence: Input " << pin->name << " needs edge detection on the "
+              << ( GPIO_V2_LINE_FLAG_EDGE_RISING == edge ? "rising" : "falling" ) << " edge" << std::endl;
+    return false;
+  }
+
+  pin->pinfo = pinfo;
+  pin->offset = pinfo->cold->offsets[ __builtin_ctzll( mask ) ];
+  return true;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Resolve records of all rules and arm their inputs
+//!
+//! Called after the records have been initialized.
+//!
+//! @param   [in]  pool      Address of the pool of private device data
+//! @param   [in]  used      Number of used entries in the pool
+//! @param   [in]  handlers  Interrupt handlers of all groups
+//!
+//! @return  false in case of an error
+//------------------------------------------------------------------------------
+bool GpioCoincidence::resolve( devGpio_info_t* pool, epicsUInt32 used, std::vector<GpioIntHandler*> const& handlers ) {
+  _resolved = true;
+  _byInput.resize( used );
+
+  bool ok = true;
+  for( auto r : _rules ) {
+    bool valid = resolveInput( &r->inputs[0], pool, used );
+    valid = resolveInput( &r->inputs[1], pool, used ) && valid;
+    if( !valid ) {
+      r->inputs[0].pinfo = r->inputs[1].pinfo = nullptr;
+      ok = false;
+      continue;
+    }
+    for( auto const& in : r->inputs ) {
+      std::vector<rule_t*>& rules = _byInput[ in.pinfo->index ];
+      if( rules.empty() || rules.back() != r ) rules.push_back( r );
+    }
+  }
+
+  for( epicsUInt32 i = 0; i < used; ++i ) {
+    if( _byInput[i].empty() ) continue;
+    pool[i].coinc = &_byInput[i];
+    handlers[pool[i].group]->registerInterrupt( &pool[i] );
+  }
+
+  return ok;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Match the edge events of a line request against all rules
+//!
+//! Called by the interrupt handler right after the events have been read.
+//!
+//! @param   [in]  pinfo   Address of the input's private data structure
+//! @param   [in]  events  Edge events read from the line request
+//! @param   [in]  nev     Number of events
+//------------------------------------------------------------------------------
+void GpioCoincidence::trigger( devGpio_info_t* pinfo, struct gpio_v2_line_event const* events, size_t nev ) {
+  for( auto r : *static_cast< std::vector<rule_t*>* >( pinfo->coinc ) ) {
+    r->lock.lock();
+    for( size_t i = 0; i < nev; ++i ) {
+      for( int k = 0; k < 2; ++k ) {
+        input_t const& in = r->inputs[k];
+        if( in.pinfo != pinfo || in.offset != events[i].offset || in.id != events[i].id ) continue;
+        match( r, k, events[i].timestamp_ns );
+      }
+    }
+    r->lock.unlock();
+  }
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Edge detection of a line request was disabled or enabled again
+//!
+//! Called by the interrupt handler. Unmatched edges of the line request are
+//! dropped, as the edges in between are missing, and the records of the
+//! rules are processed to show or clear the storm alarm.
+//!
+//! @param   [in]  pinfo   Address of the input's private data structure
+//------------------------------------------------------------------------------
+void GpioCoincidence::storm( devGpio_info_t* pinfo ) {
+  for( auto r : *static_cast< std::vector<rule_t*>* >( pinfo->coinc ) ) {
+    r->lock.lock();
+    for( auto& in : r->inputs ) {
+      if( in.pinfo == pinfo ) in.last_ns = 0;
+    }
+    r->lock.unlock();
+    scanIoRequest( r->ioscanpvt );
+  }
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Match a single edge against the pending edge of the other input
+//!
+//! Edges of the two inputs may be read in any order, as they can be in
+//! different line requests or handled by different threads. Only the
+//! kernel timestamps are compared. Has to be called with the rule's lock held.
+//!
+//! @param   [in]  prule         Address of the rule
+//! @param   [in]  k             Index of the input the edge belongs to
+//! @param   [in]  timestamp_ns  Kernel timestamp of the edge
+//------------------------------------------------------------------------------
+void GpioCoincidence::match( rule_t* prule, int k, epicsUInt64 timestamp_ns ) {
+  input_t& in = prule->inputs[k];
+  input_t& other = prule->inputs[1 - k];
+
+  epicsInt64 delta = (epicsInt64)( timestamp_ns - other.last_ns );
+  if( 0 == other.last_ns || (epicsUInt64)llabs( delta ) > prule->window_ns ) {
+    if( timestamp_ns > in.last_ns ) in.last_ns = timestamp_ns;
+    return;
+  }
+
+  // time from first to second input
+  if( 0 == k ) delta = -delta;
+  bool inorder = !prule->ordered || 0 <= delta;
+
+  in.last_ns = other.last_ns = 0;
+  prule->delta_ns = delta;
+  prule->inorder = inorder;
+  if( !inorder ) __atomic_store_n( &prule->nviolations, prule->nviolations + 1, __ATOMIC_RELAXED );
+  __atomic_store_n( &prule->ncoinc, prule->ncoinc + 1, __ATOMIC_RELAXED );
+
+  scanIoRequest( prule->ioscanpvt );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Print status of all rules
+//------------------------------------------------------------------------------
+void GpioCoincidence::report() const {
+  for( auto r : _rules ) {
+    std::cout << "  coincidence " << r->name << ": "
+              << ( r->inputs[0].pinfo ? "" : "invalid, " )
+              << r->inputs[0].name << ( r->ordered ? " -> " : " <-> " ) << r->inputs[1].name
+              << " within " << r->window_ns << " ns, matches " << r->ncoinc
+              << ", violations " << r->nviolations << ", last delta " << r->delta_ns << " ns"
+              << std::endl;
+  }
+}
@@ -0,0 +1,101 @@
+//******************************************************************************
+// Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+//                    - Helmholtz-Institut Mainz
+//
+// This file is part of devGpio
+//
+// devGpio is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// devGpio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// version 1.0.0; Aug 13, 2015
+//
+//******************************************************************************
+
+#ifndef DEV_GPIO_COINCIDENCE_H
+#define DEV_GPIO_COINCIDENCE_H
+
+//_____ I N C L U D E S ________________________________________________________
+
+// ANSI C/C++ includes
+#include <string>
+#include <vector>
+#include <linux/gpio.h>
+
+// EPICS includes
+#include <dbScan.h>
+#include <epicsMutex.h>
+#include <epicsTypes.h>
+
+// local includes
+#include "devGpio.h"
+
+//_____ D E F I N I T I O N S __________________________________________________
+
+// forward declaration
+class GpioIntHandler;
+
+//! @brief   Coincidence and sequence detection between edges of two lines
+//!
+//! Edge events of two lines are matched by their kernel timestamps in the
+//! interrupt thread. Two edges within the window are a coincidence; for
+//! ordered rules a coincidence where the second edge came first is counted
+//! as order violation. Records are only processed on matches.
+class GpioCoincidence {
+  public:
+    GpioCoincidence();
+    virtual ~GpioCoincidence();
+    GpioCoincidence( GpioCoincidence const& rother ); // Not implemented
+    GpioCoincidence& operator=( GpioCoincidence const& rother ); // Not implemented
+
+    struct input_t {
+      std::string name;
+      devGpio_info_t* pinfo;
+      epicsUInt32 offset;
+      epicsUInt32 id;                //!< GPIO_V2_LINE_EVENT_RISING_EDGE or _FALLING_EDGE
+      epicsUInt64 last_ns;           //!< Timestamp of unmatched edge, 0 if none
+    };
+
+    struct rule_t {
+      std::string name;
+      input_t inputs[2];
+      epicsUInt64 window_ns;
+      bool ordered;
+      epicsUInt64 ncoinc;            //!< Number of coincidences (incl. violations)
+      epicsUInt64 nviolations;       //!< Number of order violations
+      epicsInt64 delta_ns;           //!< Time from first to second edge of last match
+      epicsUInt8 inorder;            //!< Last match was in order
+      IOSCANPVT ioscanpvt;
+      epicsMutex lock;
+    };
+
+    bool add( std::string const& name, std::string const& first, std::string const& second,
+              double window_us, bool ordered );
+    rule_t* find( std::string const& name ) const;
+    bool resolve( devGpio_info_t* pool, epicsUInt32 used, std::vector<GpioIntHandler*> const& handlers );
+    void report() const;
+
+    static void trigger( devGpio_info_t* pinfo, struct gpio_v2_line_event const* events, size_t nev );
+    static void storm( devGpio_info_t* pinfo );
+
+  private:
+
+    static bool resolveInput( input_t* pin, devGpio_info_t* pool, epicsUInt32 used );
+    static void match( rule_t* prule, int k, epicsUInt64 timestamp_ns );
+
+    bool _resolved;
+    std::vector<rule_t*> _rules;
+    std::vector< std::vector<rule_t*> > _byInput;
+};
+
+#endif
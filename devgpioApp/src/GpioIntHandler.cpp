@@ -34,8 +34,13 @@
 #include <cstdio>
 #include <cerrno>
 #include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sstream>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <linux/gpio.h>
 
@@ -44,97 +49,571 @@
 // local includes
 #include "devGpio.h"
 #include "GpioIntHandler.hpp"
+#include "GpioCoincidence.hpp"
+#include "GpioReflex.hpp"
 
 //_____ D E F I N I T I O N S __________________________________________________
 
+//! Maximum number of file descriptors handled per wakeup
+#define MAX_EPOLL_EVENTS 16
+
+//! Maximum number of edge events read from a line request at once
+#define MAX_LINE_EVENTS 16
+
+//! Window for counting edge events of a line request
+#define STORM_WINDOW_NS 100000000ull
+
+//! Period of polling line requests with disabled edge detection
+#define STORM_POLL_NS 100000000ull
+
+//! Edge detection flags
+#define EDGE_FLAGS ( GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING )
+
 //_____ G L O B A L S __________________________________________________________
 
 //_____ L O C A L S ____________________________________________________________
 
+//------------------------------------------------------------------------------
+//! @brief   Get index of a GPIO within its line request
+//!
+//! Only line requests with more than one line look at the cold part.
+//------------------------------------------------------------------------------
+static inline epicsUInt32 lineIndex( devGpio_info_t const* pinfo, epicsUInt32 offset ) {
+  for( epicsUInt32 i = 1; i < pinfo->nlines; ++i )
+    if( pinfo->cold->offsets[i] == offset ) return i;
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Current time of the clock used for edge event timestamps
+//------------------------------------------------------------------------------
+static inline epicsUInt64 monotonic_ns() {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (epicsUInt64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Update line levels from edge events
+//!
+//! The levels are only written by the interrupt thread of the line request,
+//! but read by the reflex rules of other threads.
+//------------------------------------------------------------------------------
+static inline void updateLevels( devGpio_info_t* pinfo, struct gpio_v2_line_event const* events, size_t nev ) {
+  epicsUInt64 levels = pinfo->levels;
+  for( size_t k = 0; k < nev; ++k ) {
+    epicsUInt64 bit = 1ull << lineIndex( pinfo, events[k].offset );
+    if( GPIO_V2_LINE_EVENT_RISING_EDGE == events[k].id ) levels |= bit;
+    else                                                 levels &= ~bit;
+  }
+  __atomic_store_n( &pinfo->levels, levels, __ATOMIC_RELAXED );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Decode edge events of a quadrature encoder
+//!
+//! Lines are A, B and an optional index. The events of a line request are
+//! ordered by their seqno, each event changes a single line. An edge got
+//! lost if the seqno of its line has a gap, or if the next edge of the line
+//! does not change its level. Both are counted as errors, the position may
+//! be off by the missed steps. A rising edge of the index resets the position.
+//------------------------------------------------------------------------------
+static void decodeQuad( devGpio_info_t* pinfo, struct gpio_v2_line_event const* events, size_t nev ) {
+  // position step for transition from state (B<<1|A) to state (B<<1|A),
+  // transitions of both lines cannot be reported by a single event
+  static signed char const steps[16] = {
+    0, 1, -1, 0,
+    -1, 0, 0, 1,
+    1, 0, 0, -1,
+    0, -1, 1, 0
+  };
+
+  devGpio_quad_t *pquad = (devGpio_quad_t*)pinfo->ext;
+  epicsInt64 position = pquad->position;
+  epicsUInt64 levels = pinfo->levels;
+  for( size_t k = 0; k < nev; ++k ) {
+    epicsUInt32 idx = lineIndex( pinfo, events[k].offset );
+    if( 0 != pquad->seqno[idx] && events[k].line_seqno != pquad->seqno[idx] + 1 ) pquad->nerrors++;
+    pquad->seqno[idx] = events[k].line_seqno;
+
+    epicsUInt32 prev = levels & 3u;
+    epicsUInt64 bit = 1ull << idx;
+    bool rising = ( GPIO_V2_LINE_EVENT_RISING_EDGE == events[k].id );
+    if( rising == ( 0 != ( levels & bit ) ) ) {
+      // redundant edge, the opposite one got lost
+      pquad->nerrors++;
+      continue;
+    }
+    if( rising ) levels |= bit;
+    else         levels &= ~bit;
+
+    if( 2 == idx ) {
+      if( rising ) {
+        position = 0;
+        __atomic_store_n( &pquad->stale, 0, __ATOMIC_RELAXED );
+      }
+      continue;
+    }
+    position += steps[ ( prev << 2 ) | ( levels & 3u ) ];
+  }
+  __atomic_store_n( &pinfo->levels, levels, __ATOMIC_RELAXED );
+  __atomic_store_n( &pquad->position, position, __ATOMIC_RELAXED );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Add a measurement to the current window of a pulse measurement
+//------------------------------------------------------------------------------
+static inline void accumulate( devGpio_pulse_t* ppulse, int quantity, double value ) {
+  if( 0 == ppulse->n[quantity] || value < ppulse->min[quantity] ) ppulse->min[quantity] = value;
+  if( 0 == ppulse->n[quantity] || value > ppulse->max[quantity] ) ppulse->max[quantity] = value;
+  ppulse->sum[quantity] += value;
+  ppulse->n[quantity]++;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Pair rising and falling edges of a single line
+//!
+//! Widths are the differences of the kernel timestamps of consecutive
+//! edges, the period the difference of consecutive rising edges. A gap in
+//! the line seqno discards the edges seen so far.
+//------------------------------------------------------------------------------
+static void decodePulse( devGpio_info_t* pinfo, struct gpio_v2_line_event const* events, size_t nev ) {
+  devGpio_pulse_t *ppulse = (devGpio_pulse_t*)pinfo->ext;
+  epicsUInt64 levels = pinfo->levels;
+  for( size_t k = 0; k < nev; ++k ) {
+    epicsUInt64 ts = events[k].timestamp_ns;
+    if( 0 != ppulse->seqno && events[k].line_seqno != ppulse->seqno + 1 ) {
+      ppulse->rise_ns = 0;
+      ppulse->fall_ns = 0;
+    }
+    ppulse->seqno = events[k].line_seqno;
+
+    if( GPIO_V2_LINE_EVENT_RISING_EDGE == events[k].id ) {
+      levels |= 1ull;
+      if( 0 != ppulse->fall_ns && ppulse->fall_ns > ppulse->rise_ns )
+        accumulate( ppulse, DEVGPIO_PULSE_LOW, ( ts - ppulse->fall_ns ) * 1e-3 );
+      if( 0 != ppulse->rise_ns && ts > ppulse->rise_ns ) {
+        double period = ( ts - ppulse->rise_ns ) * 1e-3;
+        accumulate( ppulse, DEVGPIO_PULSE_PERIOD, period );
+        if( ppulse->fall_ns > ppulse->rise_ns )
+          accumulate( ppulse, DEVGPIO_PULSE_DUTY, ( ppulse->fall_ns - ppulse->rise_ns ) * 1e-1 / period );
+      }
+      ppulse->rise_ns = ts;
+    } else {
+      levels &= ~1ull;
+      if( 0 != ppulse->rise_ns && ppulse->rise_ns > ppulse->fall_ns )
+        accumulate( ppulse, DEVGPIO_PULSE_HIGH, ( ts - ppulse->rise_ns ) * 1e-3 );
+      ppulse->fall_ns = ts;
+    }
+  }
+  __atomic_store_n( &pinfo->levels, levels, __ATOMIC_RELAXED );
+}
+
 //_____ F U N C T I O N S ______________________________________________________
 
+//------------------------------------------------------------------------------
+//! @brief   Parse a list of CPUs like "0,2-3"
+//!
+//! @return  false in case of an error
+//------------------------------------------------------------------------------
+static bool parseCpus( std::string const& cpus, cpu_set_t* pset ) {
+  CPU_ZERO( pset );
+  std::istringstream ss( cpus );
+  std::string range;
+  while( std::getline( ss, range, ',' ) ) {
+    unsigned first, last;
+    char dash;
+    std::istringstream rs( range );
+    if( !( rs >> first ) ) return false;
+    last = first;
+    if( rs >> dash && ( '-' != dash || !( rs >> last ) ) ) return false;
+    for( unsigned cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu ) CPU_SET( cpu, pset );
+  }
+  return 0 != CPU_COUNT( pset );
+}
+
 //------------------------------------------------------------------------------
 //! @brief   Standard Constructor
+//!
+//! @param   [in]  name      Name of the group, used for the thread name
+//! @param   [in]  priority  EPICS priority of the thread
+//! @param   [in]  cpus      CPUs the thread may run on, empty for all
+//! @param   [in]  pool      Address of the pool of private device data
+//! @param   [in]  size      Number of entries in the pool
 //------------------------------------------------------------------------------
-GpioIntHandler::GpioIntHandler()
-  : thread( *this, "devGpio", epicsThreadGetStackSize( epicsThreadStackSmall ), 50 )
+GpioIntHandler::GpioIntHandler( std::string const& name, unsigned int priority, std::string const& cpus,
+                                devGpio_info_t* pool, epicsUInt32 size )
+  : thread( *this, ( "devGpio" + ( name.empty() ? "" : "-" + name ) ).c_str(),
+            epicsThreadGetStackSize( epicsThreadStackSmall ), priority ),
+    _name( name ),
+    _affinity( false ),
+    _pause( 5 ),
+    _pool( pool ),
+    _recorder( nullptr ),
+    _shm( nullptr ),
+    _stormLimit( 0 ),
+    _quiet_ns( 0 ),
+    _polled_ns( 0 )
 {
-  _pause = 5;
-  _recs.clear();
+  _pending.reserve( size );
+  _throttled.reserve( size );
+  if( !cpus.empty() ) {
+    _affinity = parseCpus( cpus, &_cpus );
+    if( !_affinity ) std::cerr << "GpioIntHandler: Invalid list of CPUs: " << cpus << std::endl;
+  }
+  _epfd = epoll_create1( EPOLL_CLOEXEC );
+  if( -1 == _epfd ) {
+    perror( "GpioIntHandler: Failed to create epoll instance: " );
+  }
 }
 
 //------------------------------------------------------------------------------
 //! @brief   Standard Destructor
 //------------------------------------------------------------------------------
 GpioIntHandler::~GpioIntHandler() {
-  _recs.clear();
+  if( -1 != _epfd ) close( _epfd );
 }
 
 //------------------------------------------------------------------------------
 //! @brief   Run operation of thread
 //!
+//! Waits for edge events on all registered line requests and requests the
+//! callback of the owning record, or triggers the I/O Intr scan list of
+//! shared line requests. Reflex rules depending on the lines are evaluated
+//! before any record is notified. Only the pool entries of the lines which
+//! are ready are touched.
 //------------------------------------------------------------------------------
 void GpioIntHandler::run() {
+  struct epoll_event ready[ MAX_EPOLL_EVENTS ];
+  struct gpio_v2_line_event events[ MAX_LINE_EVENTS ];
+
+  if( _affinity ) {
+    int rtn = pthread_setaffinity_np( pthread_self(), sizeof( _cpus ), &_cpus );
+    if( 0 != rtn ) fprintf( stderr, "GpioIntHandler: Failed to set CPU affinity: %s\n", strerror( rtn ) );
+  }
 
   while( true ) {
-    if( _recs.empty() ) {
+    int timeout = (int)( _pause * 1000 );
+    if( !_pending.empty() ) timeout = flush();
+    if( !_throttled.empty() ) timeout = std::min( timeout, poll() );
+
+    int nfds = epoll_wait( _epfd, ready, MAX_EPOLL_EVENTS, timeout );
+    if( -1 == nfds ) {
+      if( EINTR == errno ) continue;
+      perror( "GpioIntHandler: Failed to wait for events: " );
       this->thread.sleep( _pause );
       continue;
     }
 
-    for( auto r : _recs ) {
-      struct gpio_v2_line_event event;
-      ssize_t rtn = read( r->fd, &event, sizeof(event));
+    for( int i = 0; i < nfds; ++i ) {
+      devGpio_info_t *pinfo = _pool + ready[i].data.u32;
+      ssize_t rtn = read( pinfo->fd, events, sizeof( events ));
       if( -1 == rtn ) {
-        if( errno == -EAGAIN ) {
-          // nothing to read
-          continue;
-        } else {
-          perror( "GpioIntHandler: Failed to read event: " );
-          continue;
-        }
+        if( EAGAIN != errno ) perror( "GpioIntHandler: Failed to read event: " );
+        continue;
+      }
+      size_t nev = rtn / sizeof( events[0] );
+      if( 0 == nev ) {
+        fprintf( stderr, "GpioIntHandler: Failed to read event: short read\n" );
+        continue;
       }
-      if( rtn != sizeof( event )) {
-        perror( "GpioIntHandler: Failed to read event: " );
+
+      if( _recorder ) _recorder->record( events, nev );
+      if( 0 != _stormLimit && !pinfo->throttled ) checkStorm( pinfo, nev, events[nev - 1].timestamp_ns );
+
+      if( DEVGPIO_MODE_QUAD == pinfo->mode )       decodeQuad( pinfo, events, nev );
+      else if( DEVGPIO_MODE_PULSE == pinfo->mode ) decodePulse( pinfo, events, nev );
+      else                                         updateLevels( pinfo, events, nev );
+
+      struct gpio_v2_line_event const& last = events[nev - 1];
+      if( 0 != pinfo->nevents && last.seqno > pinfo->event.seqno + nev )
+        pinfo->nlost += last.seqno - pinfo->event.seqno - nev;
+      pinfo->event = last;
+      __atomic_store_n( &pinfo->nevents, pinfo->nevents + nev, __ATOMIC_RELAXED );
+      __atomic_store_n( &pinfo->trigger_ns, last.timestamp_ns, __ATOMIC_RELEASE );
+      pinfo->change_ns = last.timestamp_ns;
+      if( _shm ) _shm->edges( pinfo->index, pinfo->levels, pinfo->nevents, last.timestamp_ns );
+
+      if( pinfo->reflex ) GpioReflex::trigger( pinfo );
+      if( pinfo->coinc ) GpioCoincidence::trigger( pinfo, events, nev );
+
+      notify( pinfo, last.timestamp_ns );
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Notify records about new edge events
+//!
+//! Line requests with a publish period are published at most once per
+//! period. Further events within the period are collected and published
+//! by flush() when the period has elapsed, so the final state is never lost.
+//! Pulse measurements start their window with the first edge after an idle
+//! period and are published when the window has elapsed.
+//!
+//! @param   [in]  pinfo  Address of the line's private data structure
+//! @param   [in]  ts     Timestamp of the last edge event
+//------------------------------------------------------------------------------
+void GpioIntHandler::notify( devGpio_info_t* pinfo, epicsUInt64 ts ) {
+  if( 0 != pinfo->period_ns ) {
+    if( pinfo->pending ) return;
+    // kernel timestamps of events read after a flush may be older than its "now"
+    if( DEVGPIO_MODE_PULSE == pinfo->mode
+        || (epicsInt64)( ts - pinfo->published_ns ) < (epicsInt64)pinfo->period_ns ) {
+      if( DEVGPIO_MODE_PULSE == pinfo->mode ) pinfo->published_ns = ts;
+      pinfo->pending = 1;
+      _pending.push_back( pinfo->index );
+      return;
+    }
+  }
+  if( publish( pinfo, ts ) ) {
+    pinfo->pending = 1;
+    _pending.push_back( pinfo->index );
+  }
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Publish the current state of a line request
+//!
+//! Updates the values derived from the edge events and processes the
+//! records in the I/O Intr scan list. Line requests with a fast path post
+//! their state without processing the record.
+//!
+//! @param   [in]  pinfo  Address of the line's private data structure
+//! @param   [in]  ts     Time of publishing
+//!
+//! @return  true if another publish is needed after the next period
+//------------------------------------------------------------------------------
+bool GpioIntHandler::publish( devGpio_info_t* pinfo, epicsUInt64 ts ) {
+  bool again = false;
+
+  if( DEVGPIO_MODE_QUAD == pinfo->mode ) {
+    devGpio_quad_t *pquad = (devGpio_quad_t*)pinfo->ext;
+    epicsInt64 position = pquad->position;
+    double velocity = 0.;
+    if( 0 != pinfo->published_ns && ts > pinfo->published_ns )
+      velocity = ( position - pquad->pubPosition ) * 1e9 / ( ts - pinfo->published_ns );
+    pquad->pubPosition = position;
+    __atomic_store( &pquad->pubVelocity, &velocity, __ATOMIC_RELAXED );
+    // publish once more without movement to bring velocity back to zero
+    again = ( 0. != velocity );
+  } else if( DEVGPIO_MODE_PULSE == pinfo->mode ) {
+    devGpio_pulse_t *ppulse = (devGpio_pulse_t*)pinfo->ext;
+    epicsMutexLock( ppulse->lock );
+    for( int q = 0; q < DEVGPIO_PULSE_NQ; ++q ) {
+      ppulse->pubN[q] = ppulse->n[q];
+      ppulse->pub[q][DEVGPIO_STAT_MEAN] = ppulse->n[q] ? ppulse->sum[q] / ppulse->n[q] : 0.;
+      ppulse->pub[q][DEVGPIO_STAT_MIN] = ppulse->min[q];
+      ppulse->pub[q][DEVGPIO_STAT_MAX] = ppulse->max[q];
+      // keep windows going while the line is toggling
+      if( 0 != ppulse->n[q] ) again = true;
+      ppulse->n[q] = 0;
+      ppulse->sum[q] = 0.;
+    }
+    ppulse->pubLevel = pinfo->levels & 1u;
+    epicsMutexUnlock( ppulse->lock );
+  }
+  pinfo->published_ns = ts;
+
+  if( 0 != pinfo->nintr ) {
+    if( pinfo->post )        pinfo->post( pinfo, pinfo->change_ns );
+    else if( pinfo->shared ) scanIoRequest( pinfo->ioscanpvt );
+    else                     callbackRequest( &pinfo->callback );
+  }
+  return again && 0 != pinfo->period_ns;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Publish line requests whose period has elapsed
+//!
+//! @return  Time in ms until the next pending line request is due
+//------------------------------------------------------------------------------
+int GpioIntHandler::flush() {
+  epicsUInt64 now = monotonic_ns();
+  epicsUInt64 next = 0;
+
+  for( size_t i = 0; i < _pending.size(); ) {
+    devGpio_info_t *pinfo = _pool + _pending[i];
+    epicsUInt64 deadline = pinfo->published_ns + pinfo->period_ns;
+    if( now >= deadline ) {
+      if( !publish( pinfo, now ) ) {
+        pinfo->pending = 0;
+        _pending[i] = _pending.back();
+        _pending.pop_back();
         continue;
       }
-      callbackRequest( r->pcallback );
+      deadline = now + pinfo->period_ns;
     }
+    if( 0 == next || deadline < next ) next = deadline;
+    ++i;
   }
+
+  if( 0 == next ) return (int)( _pause * 1000 );
+  return (int)( ( next - now + 999999ull ) / 1000000ull );
 }
 
 //------------------------------------------------------------------------------
-//! @brief   Add a record to the list
+//! @brief   Set the limits of the interrupt storm protection
 //!
-//! Registers a new record to be checked by the thread
+//! @param   [in]  rate   Maximum number of edge events per second and line
+//!                       request, 0 disables the protection
+//! @param   [in]  quiet  Time in seconds the levels have to be stable before
+//!                       edge detection is enabled again
+//------------------------------------------------------------------------------
+void GpioIntHandler::setStormLimit( double rate, double quiet ) {
+  _stormLimit = ( 0. < rate ) ? std::max( (epicsUInt64)( rate * STORM_WINDOW_NS / 1e9 ), (epicsUInt64)1 ) : 0;
+  _quiet_ns = ( 0. < quiet ) ? (epicsUInt64)( quiet * 1e9 ) : 0;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Disable edge detection of a line request above the rate limit
+//!
+//! The lines are polled slowly by poll() instead, until they are quiet.
 //!
-//! @param   [in]  prec  Address of the record to be added
+//! @param   [in]  pinfo  Address of the line's private data structure
+//! @param   [in]  nev    Number of edge events just read
+//! @param   [in]  ts     Timestamp of the last edge event
 //------------------------------------------------------------------------------
-void GpioIntHandler::registerInterrupt( dbCommon *prec ) {
-  devGpio_info_t *pinfo = (devGpio_info_t *)prec->dpvt;
-  if( !pinfo->pcallback ) {
-    CALLBACK *pcallback = new CALLBACK;
-    callbackSetCallback( devGpioCallback, pcallback );
-    callbackSetUser( (void*)prec, pcallback );
-    callbackSetPriority( priorityLow, pcallback );
-    pinfo->pcallback = pcallback;
+void GpioIntHandler::checkStorm( devGpio_info_t* pinfo, size_t nev, epicsUInt64 ts ) {
+  if( ts - pinfo->storm_ns >= STORM_WINDOW_NS ) {
+    pinfo->storm_ns = ts;
+    pinfo->stormEvents = 0;
   }
-  _recs.push_back( pinfo );
+  pinfo->stormEvents += nev;
+  if( pinfo->stormEvents <= _stormLimit ) return;
+
+  if( !configure( pinfo, pinfo->cold->flags & ~EDGE_FLAGS ) ) return;
+  __atomic_store_n( &pinfo->throttled, 1, __ATOMIC_RELAXED );
+  if( DEVGPIO_MODE_QUAD == pinfo->mode )
+    __atomic_store_n( &((devGpio_quad_t*)pinfo->ext)->stale, 1, __ATOMIC_RELAXED );
+  if( pinfo->coinc ) GpioCoincidence::storm( pinfo );
+  pinfo->cold->nstorms++;
+  pinfo->storm_ns = monotonic_ns();
+  _throttled.push_back( pinfo->index );
+  fprintf( stderr, "%s: Interrupt storm, edge detection disabled\n", pinfo->prec->name );
 }
 
 //------------------------------------------------------------------------------
-//! @brief   Remove a record to the list
+//! @brief   Change the flags of a line request
 //!
-//! Removes a record from the list which is checked by the thread for updates
+//! Lines switched to input by an attribute of the request stay inputs.
+//!
+//! @return  false in case of an error
+//------------------------------------------------------------------------------
+bool GpioIntHandler::configure( devGpio_info_t* pinfo, epicsUInt64 flags ) {
+  struct gpio_v2_line_config config;
+  memset( &config, 0, sizeof( config ) );
+  config.flags = flags;
+  if( 0 != pinfo->cold->inmask ) {
+    // keep the lines switched to input at the request
+    config.num_attrs = 1;
+    config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+    config.attrs[0].attr.flags = ( flags & GPIO_V2_LINE_FLAG_ACTIVE_LOW ) | GPIO_V2_LINE_FLAG_INPUT;
+    config.attrs[0].mask = pinfo->cold->inmask;
+  }
+  if( -1 == ioctl( pinfo->fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config ) ) {
+    fprintf( stderr, "%s: Failed to configure gpio lines: %s\n",
+             pinfo->prec->name, strerror( errno ) );
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Poll line requests with disabled edge detection
+//!
+//! Changes of the levels are published like edge events. Edge detection is
+//! enabled again once the levels have been stable for the quiet period.
+//!
+//! @return  Time in ms until the next poll is due
+//------------------------------------------------------------------------------
+int GpioIntHandler::poll() {
+  epicsUInt64 now = monotonic_ns();
+  if( now - _polled_ns < STORM_POLL_NS )
+    return (int)( ( STORM_POLL_NS - ( now - _polled_ns ) + 999999ull ) / 1000000ull );
+  _polled_ns = now;
+
+  for( size_t i = 0; i < _throttled.size(); ) {
+    devGpio_info_t *pinfo = _pool + _throttled[i];
+    struct gpio_v2_line_values values = { 0, devGpioMask( pinfo->nlines ) };
+    if( -1 == ioctl( pinfo->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values ) ) {
+      fprintf( stderr, "%s: Could not read gpio lines: %s\n", pinfo->prec->name, strerror( errno ) );
+    } else if( values.bits != pinfo->levels ) {
+      __atomic_store_n( &pinfo->levels, values.bits, __ATOMIC_RELAXED );
+      pinfo->change_ns = now;
+      pinfo->storm_ns = now;
+      if( _shm ) _shm->levels( pinfo->index, values.bits, values.mask );
+      if( pinfo->reflex ) GpioReflex::trigger( pinfo );
+      notify( pinfo, now );
+    } else if( now - pinfo->storm_ns >= _quiet_ns && configure( pinfo, pinfo->cold->flags ) ) {
+      pinfo->storm_ns = now;
+      pinfo->stormEvents = 0;
+      __atomic_store_n( &pinfo->throttled, 0, __ATOMIC_RELAXED );
+      if( DEVGPIO_MODE_QUAD == pinfo->mode ) {
+        // the position stays stale until the next index
+        devGpio_quad_t *pquad = (devGpio_quad_t*)pinfo->ext;
+        memset( pquad->seqno, 0, sizeof( pquad->seqno ) );
+      } else if( DEVGPIO_MODE_PULSE == pinfo->mode ) {
+        // edges before the storm must not be paired with new ones, the
+        // window starts over
+        devGpio_pulse_t *ppulse = (devGpio_pulse_t*)pinfo->ext;
+        ppulse->rise_ns = 0;
+        ppulse->fall_ns = 0;
+        for( int q = 0; q < DEVGPIO_PULSE_NQ; ++q ) {
+          ppulse->n[q] = 0;
+          ppulse->sum[q] = 0.;
+        }
+      }
+      if( pinfo->coinc ) GpioCoincidence::storm( pinfo );
+      fprintf( stderr, "%s: Edge detection enabled again\n", pinfo->prec->name );
+      notify( pinfo, now );
+      _throttled[i] = _throttled.back();
+      _throttled.pop_back();
+      continue;
+    }
+    ++i;
+  }
+  return (int)( STORM_POLL_NS / 1000000ull );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Add a line request to the list
+//!
+//! Registers the file descriptor of a line request to be watched by the
+//! thread. Line requests are reference counted, the file descriptor is
+//! watched as long as the line request has at least one user. Called by
+//! the init, scan and iocsh threads, the count is protected by a lock.
 //!
 //! @param   [in]  pinfo  Address of the record's private data structure
 //------------------------------------------------------------------------------
-void GpioIntHandler::cancelInterrupt( devGpio_info_t* pinfo ) {
-  std::vector<devGpio_info_t const*>::iterator it = std::find( _recs.begin(), _recs.end(), pinfo );
-  _recs.erase(it);
-  if( pinfo->pcallback ) {
-    delete pinfo->pcallback;
-    pinfo->pcallback = nullptr;
+void GpioIntHandler::registerInterrupt( devGpio_info_t* pinfo ) {
+  struct epoll_event ev;
+  memset( &ev, 0, sizeof( ev ));
+  ev.events = EPOLLIN;
+  ev.data.u32 = pinfo->index;
+  _armLock.lock();
+  if( 0 == pinfo->cold->narmed++
+      && -1 == epoll_ctl( _epfd, EPOLL_CTL_ADD, pinfo->fd, &ev ) ) {
+    fprintf( stderr, "%s: Failed to register interrupt: %s\n",
+             pinfo->prec->name, strerror( errno ) );
   }
+  _armLock.unlock();
 }
 
+//------------------------------------------------------------------------------
+//! @brief   Remove a line request from the list
+//!
+//! Removes a line request from the list which is checked by the thread
+//! for updates
+//!
+//! @param   [in]  pinfo  Address of the record's private data structure
+//------------------------------------------------------------------------------
+void GpioIntHandler::cancelInterrupt( devGpio_info_t* pinfo ) {
+  _armLock.lock();
+  if( 0 == --pinfo->cold->narmed
+      && -1 == epoll_ctl( _epfd, EPOLL_CTL_DEL, pinfo->fd, nullptr ) ) {
+    fprintf( stderr, "%s: Failed to cancel interrupt: %s\n",
+             pinfo->prec->name, strerror( errno ) );
+  }
+  _armLock.unlock();
+}
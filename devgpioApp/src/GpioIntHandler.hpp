@@ -28,25 +28,33 @@
 //_____ I N C L U D E S ________________________________________________________
 
 // ANSI C/C++ includes
+#include <string>
 #include <vector>
+#include <sched.h>
 
 // EPICS includes
+#include <epicsMutex.h>
 #include <epicsThread.h>
 #include <epicsTypes.h>
 #include <dbCommon.h>
 
 // local includes
 #include "devGpio.h"
+#include "GpioRecorder.hpp"
+#include "GpioShm.hpp"
 
 //_____ D E F I N I T I O N S __________________________________________________
 
-// forward declaration
-struct epoll_event;
-
 //! @brief   thread handling interrupts from GPIOs
+//!
+//! All line requests with edge detection of a group are watched by a single
+//! epoll instance. The epoll data of each file descriptor is the index of the
+//! line's entry in the pool of private device data. Each group has its own
+//! instance, thread priority and CPU affinity.
 class GpioIntHandler: public epicsThreadRunable {
   public:
-    GpioIntHandler();
+    GpioIntHandler( std::string const& name, unsigned int priority, std::string const& cpus,
+                    devGpio_info_t* pool, epicsUInt32 size );
     virtual ~GpioIntHandler();
     GpioIntHandler( GpioIntHandler const& rother ); // Not implemented
     GpioIntHandler& operator=( GpioIntHandler const& rother ); // Not implemented
@@ -55,13 +63,36 @@ class GpioIntHandler: public epicsThreadRunable {
 
     epicsThread thread;
 
-    void registerInterrupt( dbCommon *prec );
+    void registerInterrupt( devGpio_info_t* pinfo );
     void cancelInterrupt( devGpio_info_t* pinfo );
+    void setRecorder( GpioRecorder* recorder ) { _recorder = recorder; }
+    void setShm( GpioShm* shm ) { _shm = shm; }
+    void setStormLimit( double rate, double quiet );
+    std::string const& name() const { return _name; }
 
   private:
 
+    void notify( devGpio_info_t* pinfo, epicsUInt64 ts );
+    bool publish( devGpio_info_t* pinfo, epicsUInt64 ts );
+    int flush();
+    void checkStorm( devGpio_info_t* pinfo, size_t nev, epicsUInt64 ts );
+    bool configure( devGpio_info_t* pinfo, epicsUInt64 flags );
+    int poll();
+
+    std::string _name;
+    bool _affinity;
+    cpu_set_t _cpus;
     double _pause;
-    std::vector<devGpio_info_t const*> _recs;
+    int _epfd;
+    devGpio_info_t* _pool;
+    GpioRecorder* _recorder;
+    GpioShm* _shm;
+    std::vector<epicsUInt32> _pending;
+    std::vector<epicsUInt32> _throttled;
+    epicsUInt64 _stormLimit;
+    epicsUInt64 _quiet_ns;
+    epicsUInt64 _polled_ns;
+    epicsMutex _armLock;
 };
 
 #endif
@@ -0,0 +1,255 @@
+//******************************************************************************
+// Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+//                    - Helmholtz-Institut Mainz
+//
+// This file is part of devGpio
+//
+// devGpio is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// devGpio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// version 1.0.0; Aug 13, 2015
+//
+//******************************************************************************
+
+//! @file GpioRecorder.cpp
+//! @brief Implementation of the edge event flight recorder
+
+//_____ I N C L U D E S ________________________________________________________
+
+// ANSI C/C++ includes
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+// EPICS includes
+
+// local includes
+#include "GpioRecorder.hpp"
+
+//_____ D E F I N I T I O N S __________________________________________________
+
+static char const recorderMagic[8] = { 'G', 'P', 'I', 'O', 'R', 'E', 'C', '2' };
+
+//_____ G L O B A L S __________________________________________________________
+
+//_____ L O C A L S ____________________________________________________________
+
+//------------------------------------------------------------------------------
+//! @brief   Identifier of a variable in a VCD file
+//------------------------------------------------------------------------------
+static std::string vcdIdentifier( size_t index ) {
+  std::string id;
+  do {
+    id += (char)( '!' + index % 94 );
+    index /= 94;
+  } while( 0 != index );
+  return id;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Identifier of the current boot of the kernel
+//------------------------------------------------------------------------------
+static std::string bootId() {
+  std::ifstream file( "/proc/sys/kernel/random/boot_id" );
+  std::string id;
+  std::getline( file, id );
+  return id;
+}
+
+//_____ F U N C T I O N S ______________________________________________________
+
+//------------------------------------------------------------------------------
+//! @brief   Standard Constructor
+//------------------------------------------------------------------------------
+GpioRecorder::GpioRecorder()
+  : _size( 0 ),
+    _header( nullptr ),
+    _entries( nullptr )
+{}
+
+//------------------------------------------------------------------------------
+//! @brief   Standard Destructor
+//------------------------------------------------------------------------------
+GpioRecorder::~GpioRecorder() {
+  if( _header ) munmap( _header, _size );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Open and map the ring file
+//!
+//! An existing file with the same capacity, written since the last boot, is
+//! continued. Otherwise the file is (re)initialized, as its timestamps are
+//! not comparable to the new ones.
+//!
+//! @param   [in]  path      Path of the ring file
+//! @param   [in]  capacity  Number of edge events kept in the ring
+//!
+//! @return  false in case of an error
+//------------------------------------------------------------------------------
+bool GpioRecorder::open( std::string const& path, epicsUInt64 capacity ) {
+  if( _header || 0 == capacity ) return false;
+
+  int fd = ::open( path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+  if( -1 == fd ) {
+    std::cerr << "GpioRecorder: Could not open " << path << ": " << strerror( errno ) << std::endl;
+    return false;
+  }
+
+  _size = sizeof( GpioRecorderHeader ) + capacity * sizeof( GpioRecorderEntry );
+  if( -1 == ftruncate( fd, _size ) ) {
+    std::cerr << "GpioRecorder: Could not resize " << path << ": " << strerror( errno ) << std::endl;
+    ::close( fd );
+    return false;
+  }
+  void *addr = mmap( nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  ::close( fd );
+  if( MAP_FAILED == addr ) {
+    std::cerr << "GpioRecorder: Could not map " << path << ": " << strerror( errno ) << std::endl;
+    return false;
+  }
+
+  _header = (GpioRecorderHeader*)addr;
+  _entries = (GpioRecorderEntry*)( _header + 1 );
+  std::string boot = bootId().substr( 0, sizeof( _header->bootId ) - 1 );
+  if( 0 != memcmp( _header->magic, recorderMagic, sizeof( recorderMagic ) )
+      || sizeof( GpioRecorderEntry ) != _header->entrySize
+      || capacity != _header->capacity
+      || 0 != strncmp( _header->bootId, boot.c_str(), sizeof( _header->bootId ) ) ) {
+    memset( addr, 0, _size );
+    memcpy( _header->magic, recorderMagic, sizeof( recorderMagic ) );
+    _header->entrySize = sizeof( GpioRecorderEntry );
+    _header->capacity = capacity;
+    strcpy( _header->bootId, boot.c_str() );
+  }
+  _header->frozen = 0;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Stop or restart recording
+//------------------------------------------------------------------------------
+void GpioRecorder::freeze( bool frozen ) {
+  if( _header ) __atomic_store_n( &_header->frozen, frozen ? 1u : 0u, __ATOMIC_RELAXED );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Export the last events as VCD file
+//!
+//! Recording is stopped during the export and restarted afterwards unless
+//! it has been frozen before.
+//!
+//! @param   [in]  path    Path of the VCD file
+//! @param   [in]  window  Length of the exported time window in seconds
+//!                        before the last event, 0 exports the whole ring
+//!
+//! @return  false in case of an error
+//------------------------------------------------------------------------------
+bool GpioRecorder::exportVcd( std::string const& path, double window ) {
+  if( !_header ) {
+    std::cerr << "GpioRecorder: Not enabled" << std::endl;
+    return false;
+  }
+
+  bool wasFrozen = __atomic_load_n( &_header->frozen, __ATOMIC_RELAXED );
+  freeze( true );
+
+  // collect committed entries in chronological order; writers which passed
+  // the frozen check before may still overwrite slots, so entries whose
+  // commit changed while copying are dropped
+  epicsUInt64 head = __atomic_load_n( &_header->head, __ATOMIC_ACQUIRE );
+  epicsUInt64 first = ( head > _header->capacity ) ? head - _header->capacity : 0;
+  std::vector<GpioRecorderEntry> entries;
+  entries.reserve( head - first );
+  for( epicsUInt64 pos = first; pos < head; ++pos ) {
+    GpioRecorderEntry const& entry = _entries[ pos % _header->capacity ];
+    if( __atomic_load_n( &entry.commit, __ATOMIC_ACQUIRE ) != pos + 1 ) continue;
+    GpioRecorderEntry copy = entry;
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    if( __atomic_load_n( &entry.commit, __ATOMIC_RELAXED ) != pos + 1 ) continue;
+    entries.push_back( copy );
+  }
+
+  if( !wasFrozen ) freeze( false );
+
+  // events of different line requests are not strictly ordered in the ring
+  std::stable_sort( entries.begin(), entries.end(),
+                    []( GpioRecorderEntry const& a, GpioRecorderEntry const& b ) {
+                      return a.timestamp_ns < b.timestamp_ns;
+                    } );
+
+  epicsUInt64 start = 0;
+  if( !entries.empty() ) {
+    epicsUInt64 last = entries.back().timestamp_ns;
+    epicsUInt64 span = (epicsUInt64)( window * 1e9 );
+    start = ( 0 < window && last > span ) ? last - span : 0;
+  }
+
+  std::map<epicsUInt32, std::string> ids;
+  for( auto const& e : entries ) {
+    if( e.timestamp_ns < start || ids.count( e.offset ) ) continue;
+    ids[e.offset] = vcdIdentifier( ids.size() );
+  }
+
+  std::ofstream vcd( path.c_str() );
+  if( !vcd ) {
+    std::cerr << "GpioRecorder: Could not open " << path << std::endl;
+    return false;
+  }
+  vcd << "$version EPICS devGpio flight recorder $end\n"
+      << "$timescale 1ns $end\n"
+      << "$scope module gpio $end\n";
+  for( auto const& id : ids )
+    vcd << "$var wire 1 " << id.second << " gpio" << id.first << " $end\n";
+  vcd << "$upscope $end\n"
+      << "$enddefinitions $end\n";
+
+  epicsUInt64 tzero = 0;
+  epicsUInt64 now = 0;
+  bool firstEvent = true;
+  for( auto const& e : entries ) {
+    if( e.timestamp_ns < start ) continue;
+    if( firstEvent ) {
+      tzero = e.timestamp_ns;
+      vcd << "#0\n$dumpvars\n";
+      for( auto const& id : ids ) vcd << "x" << id.second << "\n";
+      vcd << "$end\n";
+      firstEvent = false;
+    }
+    if( e.timestamp_ns - tzero != now ) {
+      now = e.timestamp_ns - tzero;
+      vcd << "#" << now << "\n";
+    }
+    vcd << ( GPIO_V2_LINE_EVENT_RISING_EDGE == e.id ? '1' : '0' ) << ids[e.offset] << "\n";
+  }
+
+  std::cout << "GpioRecorder: Exported " << ids.size() << " lines to " << path
+            << " (t0 = " << tzero << " ns)" << std::endl;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Print status of the recorder
+//------------------------------------------------------------------------------
+void GpioRecorder::report() const {
+  if( !_header ) return;
+  std::cout << "  recorder: " << _header->head << " events recorded, capacity "
+            << _header->capacity << ( _header->frozen ? ", frozen" : "" ) << std::endl;
+}
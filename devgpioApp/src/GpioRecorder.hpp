@@ -0,0 +1,103 @@
+//******************************************************************************
+// Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+//                    - Helmholtz-Institut Mainz
+//
+// This file is part of devGpio
+//
+// devGpio is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// devGpio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// version 1.0.0; Aug 13, 2015
+//
+//******************************************************************************
+
+#ifndef DEV_GPIO_RECORDER_H
+#define DEV_GPIO_RECORDER_H
+
+//_____ I N C L U D E S ________________________________________________________
+
+// ANSI C/C++ includes
+#include <string>
+#include <linux/gpio.h>
+
+// EPICS includes
+#include <epicsTypes.h>
+
+// local includes
+
+//_____ D E F I N I T I O N S __________________________________________________
+
+//! @brief   Header of the flight recorder file
+struct GpioRecorderHeader {
+  char magic[8];            //!< "GPIOREC2"
+  epicsUInt32 entrySize;    //!< Size of a single entry
+  epicsUInt32 reserved;
+  epicsUInt64 capacity;     //!< Number of entries in the ring
+  epicsUInt64 head;         //!< Number of entries ever written
+  epicsUInt32 frozen;       //!< Recording stopped
+  char bootId[40];          //!< Boot of the kernel the timestamps (CLOCK_MONOTONIC) refer to
+};
+
+//! @brief   Single edge event in the flight recorder file
+struct GpioRecorderEntry {
+  epicsUInt64 commit;       //!< Position in the ring + 1, written last
+  epicsUInt64 timestamp_ns; //!< Kernel timestamp of the event
+  epicsUInt32 offset;       //!< GPIO line
+  epicsUInt32 id;           //!< GPIO_V2_LINE_EVENT_RISING/FALLING_EDGE
+  epicsUInt32 seqno;        //!< Sequence number within the line request
+  epicsUInt32 line_seqno;   //!< Sequence number of the line
+};
+
+//! @brief   Memory-mapped ring of edge events
+//!
+//! Edge events are appended by the interrupt thread without locks or system
+//! calls. The ring is kept in a file, so it survives a crash of the IOC, and
+//! can be exported as VCD file for a logic-analyzer view.
+class GpioRecorder {
+  public:
+    GpioRecorder();
+    virtual ~GpioRecorder();
+    GpioRecorder( GpioRecorder const& rother ); // Not implemented
+    GpioRecorder& operator=( GpioRecorder const& rother ); // Not implemented
+
+    bool open( std::string const& path, epicsUInt64 capacity );
+    void freeze( bool frozen );
+    bool exportVcd( std::string const& path, double window );
+    void report() const;
+
+    //! @brief   Append edge events to the ring
+    inline void record( struct gpio_v2_line_event const* events, size_t nev ) {
+      if( __atomic_load_n( &_header->frozen, __ATOMIC_RELAXED ) ) return;
+      epicsUInt64 pos = __atomic_fetch_add( &_header->head, nev, __ATOMIC_RELAXED );
+      for( size_t k = 0; k < nev; ++k, ++pos ) {
+        GpioRecorderEntry& entry = _entries[ pos % _header->capacity ];
+        __atomic_store_n( &entry.commit, 0, __ATOMIC_RELAXED );
+        __atomic_thread_fence( __ATOMIC_RELEASE );
+        entry.timestamp_ns = events[k].timestamp_ns;
+        entry.offset = events[k].offset;
+        entry.id = events[k].id;
+        entry.seqno = events[k].seqno;
+        entry.line_seqno = events[k].line_seqno;
+        __atomic_store_n( &entry.commit, pos + 1, __ATOMIC_RELEASE );
+      }
+    }
+
+  private:
+
+    size_t _size;
+    GpioRecorderHeader* _header;
+    GpioRecorderEntry* _entries;
+};
+
+#endif
@@ -0,0 +1,324 @@
+//******************************************************************************
+// Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+//                    - Helmholtz-Institut Mainz
+//
+// This file is part of devGpio
+//
+// devGpio is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// devGpio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// version 1.0.0; Aug 13, 2015
+//
+//******************************************************************************
+
+//! @file GpioReflex.cpp
+//! @brief Implementation of input-to-output reflexes
+
+//_____ I N C L U D E S ________________________________________________________
+
+// ANSI C/C++ includes
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+// EPICS includes
+#include <dbAccess.h>
+#include <dbBase.h>
+
+// local includes
+#include "devGpio.h"
+#include "GpioIntHandler.hpp"
+#include "GpioReflex.hpp"
+
+//_____ D E F I N I T I O N S __________________________________________________
+
+//_____ G L O B A L S __________________________________________________________
+
+//_____ L O C A L S ____________________________________________________________
+
+//_____ F U N C T I O N S ______________________________________________________
+
+//------------------------------------------------------------------------------
+//! @brief   Standard Constructor
+//------------------------------------------------------------------------------
+GpioReflex::GpioReflex()
+  : _resolved( false )
+{}
+
+//------------------------------------------------------------------------------
+//! @brief   Standard Destructor
+//------------------------------------------------------------------------------
+GpioReflex::~GpioReflex() {
+  for( auto r : _rules ) delete r;
+  _rules.clear();
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Add a new rule
+//!
+//! Names of records may be followed by ".<N>" to select the N-th GPIO of
+//! the record, and preceded by "!" to invert the level.
+//!
+//! @param   [in]  output  Name of the bo record driving the output line
+//! @param   [in]  op      Logic operation: AND, OR, XOR or LATCH
+//! @param   [in]  inputs  Space separated list of input records
+//!
+//! @return  false in case of an error
+//------------------------------------------------------------------------------
+bool GpioReflex::add( std::string const& output, std::string const& op, std::string const& inputs ) {
+  if( _resolved ) {
+    std::cerr << "GpioReflex: Rules have to be added before iocInit" << std::endl;
+    return false;
+  }
+
+  rule_t *prule = new rule_t;
+  prule->invert = ( !output.empty() && '!' == output[0] );
+  prule->name = prule->invert ? output.substr( 1 ) : output;
+  prule->pout = nullptr;
+  prule->mask = 0;
+  prule->latched = false;
+  prule->state = false;
+  prule->nfired = 0;
+
+  std::string uop( op );
+  for( auto& c : uop ) c = toupper( c );
+  if( "AND" == uop )        prule->op = AND;
+  else if( "OR" == uop )    prule->op = OR;
+  else if( "XOR" == uop )   prule->op = XOR;
+  else if( "LATCH" == uop ) prule->op = LATCH;
+  else {
+    std::cerr << "GpioReflex: Invalid operation: " << op << std::endl;
+    delete prule;
+    return false;
+  }
+
+  std::istringstream ss( inputs );
+  std::string name;
+  while( ss >> name ) {
+    input_t in;
+    in.invert = ( '!' == name[0] );
+    in.name = in.invert ? name.substr( 1 ) : name;
+    in.pinfo = nullptr;
+    in.mask = 0;
+    prule->inputs.push_back( in );
+  }
+  if( prule->name.empty() || prule->inputs.empty() ) {
+    std::cerr << "GpioReflex: Missing output or input records" << std::endl;
+    delete prule;
+    return false;
+  }
+
+  _rules.push_back( prule );
+  return true;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Release a latched rule
+//!
+//! @param   [in]  output  Name of the bo record driving the output line
+//!
+//! @return  false if no rule is driving the output
+//------------------------------------------------------------------------------
+bool GpioReflex::reset( std::string const& output ) {
+  bool found = false;
+  for( auto r : _rules ) {
+    if( r->name != output ) continue;
+    found = true;
+    r->lock.lock();
+    r->latched = false;
+    if( _resolved ) evaluate( r );
+    r->lock.unlock();
+  }
+  if( !found ) std::cerr << "GpioReflex: No rule for " << output << std::endl;
+  return found;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Find private data of a devGpio record
+//!
+//! @param   [in]  name  Name of the record, optionally followed by ".<N>"
+//! @param   [out] mask  Mask of the selected GPIO within the line request
+//! @param   [in]  pool  Address of the pool of private device data
+//! @param   [in]  used  Number of used entries in the pool
+//!
+//! @return  Address of the private data, nullptr in case of an error
+//------------------------------------------------------------------------------
+devGpio_info_t* GpioReflex::lookup( std::string const& name, epicsUInt64* mask,
+                                    devGpio_info_t* pool, epicsUInt32 used ) {
+  std::string recname( name );
+  epicsUInt32 bit = 0;
+  size_t dot = name.rfind( '.' );
+  if( std::string::npos != dot ) {
+    std::string index = name.substr( dot + 1 );
+    if( index.empty() || std::string::npos != index.find_first_not_of( "0123456789" ) ) {
+      std::cerr << "devGpio: Invalid GPIO index in " << name << std::endl;
+      return nullptr;
+    }
+    recname = name.substr( 0, dot );
+    bit = std::stoul( index );
+  }
+
+  DBADDR addr;
+  if( 0 != dbNameToAddr( recname.c_str(), &addr ) ) {
+    std::cerr << "devGpio: Unknown record " << recname << std::endl;
+    return nullptr;
+  }
+  devGpio_info_t *pinfo = (devGpio_info_t*)addr.precord->dpvt;
+  if( pinfo < pool || pinfo >= pool + used ) {
+    std::cerr << "devGpio: " << recname << " is not a devGpio record" << std::endl;
+    return nullptr;
+  }
+  if( bit >= pinfo->nlines ) {
+    std::cerr << "devGpio: " << recname << " has no GPIO " << bit << std::endl;
+    return nullptr;
+  }
+  *mask = 1ull << bit;
+  return pinfo;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Resolve records of all rules and arm their inputs
+//!
+//! Called after the records have been initialized. The outputs are set
+//! according to the current input levels.
+//!
+//! @param   [in]  pool      Address of the pool of private device data
+//! @param   [in]  used      Number of used entries in the pool
+//! @param   [in]  handlers  Interrupt handlers of all groups
+//!
+//! @return  false in case of an error
+//------------------------------------------------------------------------------
+bool GpioReflex::resolve( devGpio_info_t* pool, epicsUInt32 used, std::vector<GpioIntHandler*> const& handlers ) {
+  static epicsUInt64 const bothEdges = GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+
+  _resolved = true;
+  _byInput.resize( used );
+
+  bool ok = true;
+  for( auto r : _rules ) {
+    r->pout = lookup( r->name, &r->mask, pool, used );
+    if( !r->pout ) { ok = false; continue; }
+    if( std::string( "bo" ) != r->pout->prec->rdes->name ) {
+      std::cerr << "GpioReflex: Output " << r->name << " is not a bo record" << std::endl;
+      r->pout = nullptr;
+      ok = false;
+      continue;
+    }
+
+    bool valid = true;
+    for( auto& in : r->inputs ) {
+      in.pinfo = lookup( in.name, &in.mask, pool, used );
+      if( !in.pinfo ) { valid = false; continue; }
+      if( bothEdges != ( in.pinfo->cold->flags & bothEdges ) ) {
+        std::cerr << "GpioReflex: Input " << in.name << " needs edge detection on both edges" << std::endl;
+        valid = false;
+      }
+    }
+    if( !valid ) { r->pout = nullptr; ok = false; continue; }
+
+    r->pout->cold->reflex = true;
+    callbackSetCallback( devGpioReadback_bo, &r->callback );
+    callbackSetUser( (void*)r->pout->prec, &r->callback );
+    callbackSetPriority( priorityHigh, &r->callback );
+
+    for( auto& in : r->inputs ) {
+      std::vector<rule_t*>& rules = _byInput[ in.pinfo->index ];
+      if( rules.empty() || rules.back() != r ) rules.push_back( r );
+    }
+  }
+
+  // rules are only triggered once all of them are known
+  for( epicsUInt32 i = 0; i < used; ++i ) {
+    if( _byInput[i].empty() ) continue;
+    pool[i].reflex = &_byInput[i];
+    handlers[pool[i].group]->registerInterrupt( &pool[i] );
+  }
+
+  for( auto r : _rules ) {
+    if( !r->pout ) continue;
+    r->lock.lock();
+    evaluate( r );
+    r->lock.unlock();
+  }
+
+  return ok;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Evaluate all rules depending on a line request
+//!
+//! Called by the interrupt handler after the levels have been updated.
+//!
+//! @param   [in]  pinfo  Address of the input's private data structure
+//------------------------------------------------------------------------------
+void GpioReflex::trigger( devGpio_info_t* pinfo ) {
+  for( auto r : *static_cast< std::vector<rule_t*>* >( pinfo->reflex ) ) {
+    r->lock.lock();
+    evaluate( r );
+    r->lock.unlock();
+  }
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Evaluate a single rule
+//!
+//! Sets the output line if its level changed and requests the callback
+//! updating the output record. Has to be called with the rule's lock held.
+//!
+//! @param   [in]  prule  Address of the rule
+//------------------------------------------------------------------------------
+void GpioReflex::evaluate( rule_t* prule ) {
+  bool value = ( AND == prule->op );
+  for( auto const& in : prule->inputs ) {
+    bool level = ( 0 != ( __atomic_load_n( &in.pinfo->levels, __ATOMIC_RELAXED ) & in.mask ) ) != in.invert;
+    switch( prule->op ) {
+      case AND: value = value && level; break;
+      case XOR: value = value != level; break;
+      default:  value = value || level; break;
+    }
+  }
+  if( LATCH == prule->op ) {
+    prule->latched = prule->latched || value;
+    value = prule->latched;
+  }
+  value = value != prule->invert;
+
+  if( 0 != prule->nfired && value == prule->state ) return;
+
+  struct gpio_v2_line_values values = { value ? prule->mask : 0, prule->mask };
+  if( -1 == ioctl( prule->pout->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values ) ) {
+    fprintf( stderr, "GpioReflex: %s: Could not set gpio line: %s\n",
+             prule->name.c_str(), strerror( errno ) );
+    return;
+  }
+  devGpioShmLevels( prule->pout, values.bits, values.mask );
+  prule->state = value;
+  prule->nfired++;
+
+  callbackRequest( &prule->callback );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Print status of all rules
+//------------------------------------------------------------------------------
+void GpioReflex::report() const {
+  for( auto r : _rules ) {
+    std::cout << "  reflex " << r->name << ": " << ( r->pout ? "" : "invalid, " )
+              << "output " << r->state << ( r->latched ? " (latched)" : "" )
+              << ", fired " << r->nfired << std::endl;
+  }
+}
@@ -0,0 +1,101 @@
+//******************************************************************************
+// Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+//                    - Helmholtz-Institut Mainz
+//
+// This file is part of devGpio
+//
+// devGpio is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// devGpio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// version 1.0.0; Aug 13, 2015
+//
+//******************************************************************************
+
+#ifndef DEV_GPIO_REFLEX_H
+#define DEV_GPIO_REFLEX_H
+
+//_____ I N C L U D E S ________________________________________________________
+
+// ANSI C/C++ includes
+#include <string>
+#include <vector>
+
+// EPICS includes
+#include <callback.h>
+#include <epicsMutex.h>
+#include <epicsTypes.h>
+
+// local includes
+#include "devGpio.h"
+
+//_____ D E F I N I T I O N S __________________________________________________
+
+// forward declaration
+class GpioIntHandler;
+
+//! @brief   Input-to-output reflexes evaluated in the interrupt thread
+//!
+//! A reflex maps the levels of one or more input lines, combined by a simple
+//! logic operation, directly onto an output line. Rules are evaluated by the
+//! interrupt handler right after the edge events of an input have been read,
+//! the output record is notified afterwards.
+class GpioReflex {
+  public:
+    GpioReflex();
+    virtual ~GpioReflex();
+    GpioReflex( GpioReflex const& rother ); // Not implemented
+    GpioReflex& operator=( GpioReflex const& rother ); // Not implemented
+
+    bool add( std::string const& output, std::string const& op, std::string const& inputs );
+    bool reset( std::string const& output );
+    bool resolve( devGpio_info_t* pool, epicsUInt32 used, std::vector<GpioIntHandler*> const& handlers );
+    void report() const;
+
+    static void trigger( devGpio_info_t* pinfo );
+    static devGpio_info_t* lookup( std::string const& name, epicsUInt64* mask,
+                                   devGpio_info_t* pool, epicsUInt32 used );
+
+  private:
+
+    enum op_t { AND, OR, XOR, LATCH };
+
+    struct input_t {
+      std::string name;
+      devGpio_info_t* pinfo;
+      epicsUInt64 mask;
+      bool invert;
+    };
+
+    struct rule_t {
+      std::string name;
+      op_t op;
+      std::vector<input_t> inputs;
+      devGpio_info_t* pout;
+      epicsUInt64 mask;
+      bool invert;
+      bool latched;
+      bool state;
+      epicsUInt64 nfired;
+      CALLBACK callback;
+      epicsMutex lock;
+    };
+
+    static void evaluate( rule_t* prule );
+
+    bool _resolved;
+    std::vector<rule_t*> _rules;
+    std::vector< std::vector<rule_t*> > _byInput;
+};
+
+#endif
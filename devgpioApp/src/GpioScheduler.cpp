@@ -0,0 +1,180 @@
+//******************************************************************************
+// Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+//                    - Helmholtz-Institut Mainz
+//
+// This file is part of devGpio
+//
+// devGpio is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// devGpio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// version 1.0.0; Aug 13, 2015
+//
+//******************************************************************************
+
+//! @file GpioScheduler.cpp
+//! @brief Implementation of the time-tagged output queue
+
+//_____ I N C L U D E S ________________________________________________________
+
+// ANSI C/C++ includes
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+// EPICS includes
+
+// local includes
+#include "devGpio.h"
+#include "GpioScheduler.hpp"
+
+//_____ D E F I N I T I O N S __________________________________________________
+
+//_____ G L O B A L S __________________________________________________________
+
+//_____ L O C A L S ____________________________________________________________
+
+//------------------------------------------------------------------------------
+//! @brief   Current time of CLOCK_MONOTONIC in nanoseconds
+//------------------------------------------------------------------------------
+static epicsUInt64 monotonic_ns() {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (epicsUInt64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//_____ F U N C T I O N S ______________________________________________________
+
+//------------------------------------------------------------------------------
+//! @brief   Standard Constructor
+//!
+//! @param   [in]  capacity  Maximum number of pending commands
+//------------------------------------------------------------------------------
+GpioScheduler::GpioScheduler( epicsUInt32 capacity )
+  : thread( *this, "devGpioSched", epicsThreadGetStackSize( epicsThreadStackSmall ),
+            epicsThreadPriorityHigh ),
+    _capacity( capacity ),
+    _seq( 0 ),
+    _nexecuted( 0 ),
+    _nrejected( 0 ),
+    _nerrors( 0 ),
+    _lastLate( 0 ),
+    _maxLate( 0 ),
+    _sumLate( 0. )
+{
+  _queue.reserve( capacity );
+  pthread_mutex_init( &_lock, nullptr );
+  pthread_condattr_t attr;
+  pthread_condattr_init( &attr );
+  pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+  pthread_cond_init( &_wakeup, &attr );
+  pthread_condattr_destroy( &attr );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Standard Destructor
+//------------------------------------------------------------------------------
+GpioScheduler::~GpioScheduler() {
+  pthread_cond_destroy( &_wakeup );
+  pthread_mutex_destroy( &_lock );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Add a command to the queue
+//!
+//! @param   [in]  pinfo        Address of the output's private data structure
+//! @param   [in]  deadline_ns  Time to set the lines (CLOCK_MONOTONIC)
+//! @param   [in]  bits         Levels of the lines
+//! @param   [in]  mask         Lines to set
+//!
+//! @return  false if the queue is full
+//------------------------------------------------------------------------------
+bool GpioScheduler::schedule( devGpio_info_t* pinfo, epicsUInt64 deadline_ns, epicsUInt64 bits, epicsUInt64 mask ) {
+  pthread_mutex_lock( &_lock );
+  if( _queue.size() >= _capacity ) {
+    _nrejected++;
+    pthread_mutex_unlock( &_lock );
+    return false;
+  }
+  command_t cmd = { deadline_ns, _seq++, pinfo, bits, mask };
+  _queue.push_back( cmd );
+  std::push_heap( _queue.begin(), _queue.end() );
+  // only a new earliest deadline changes the time to wake up
+  if( _queue.front().seq == cmd.seq ) pthread_cond_signal( &_wakeup );
+  pthread_mutex_unlock( &_lock );
+  return true;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Run operation of thread
+//!
+//! Sleeps until the earliest deadline and executes all commands which are due.
+//------------------------------------------------------------------------------
+void GpioScheduler::run() {
+  pthread_mutex_lock( &_lock );
+  while( true ) {
+    if( _queue.empty() ) {
+      pthread_cond_wait( &_wakeup, &_lock );
+      continue;
+    }
+    command_t cmd = _queue.front();
+    if( cmd.deadline_ns > monotonic_ns() ) {
+      struct timespec deadline = { (time_t)( cmd.deadline_ns / 1000000000ull ),
+                                   (long)( cmd.deadline_ns % 1000000000ull ) };
+      pthread_cond_timedwait( &_wakeup, &_lock, &deadline );
+      continue;
+    }
+    std::pop_heap( _queue.begin(), _queue.end() );
+    _queue.pop_back();
+    pthread_mutex_unlock( &_lock );
+
+    struct gpio_v2_line_values values = { cmd.bits & cmd.mask, cmd.mask };
+    int rtn = ioctl( cmd.pinfo->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values );
+    epicsInt64 late = (epicsInt64)( monotonic_ns() - cmd.deadline_ns );
+    if( -1 == rtn ) {
+      fprintf( stderr, "GpioScheduler: %s: Could not set gpio lines: %s\n",
+               cmd.pinfo->prec->name, strerror( errno ) );
+    } else {
+      devGpioShmLevels( cmd.pinfo, values.bits, values.mask );
+    }
+
+    pthread_mutex_lock( &_lock );
+    if( -1 == rtn ) {
+      _nerrors++;
+      continue;
+    }
+    _nexecuted++;
+    _lastLate = late;
+    _sumLate += late;
+    if( late > _maxLate ) _maxLate = late;
+  }
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Print status of the queue
+//------------------------------------------------------------------------------
+void GpioScheduler::report() {
+  pthread_mutex_lock( &_lock );
+  std::cout << "  scheduler: pending " << _queue.size() << " of " << _capacity
+            << ", executed " << _nexecuted << ", rejected " << _nrejected
+            << ", errors " << _nerrors << std::endl
+            << "    lateness: last " << _lastLate << " ns, mean "
+            << ( _nexecuted ? (epicsInt64)( _sumLate / _nexecuted ) : 0 )
+            << " ns, max " << _maxLate << " ns" << std::endl;
+  pthread_mutex_unlock( &_lock );
+}
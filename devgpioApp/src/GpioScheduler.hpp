@@ -0,0 +1,91 @@
+//******************************************************************************
+// Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+//                    - Helmholtz-Institut Mainz
+//
+// This file is part of devGpio
+//
+// devGpio is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// devGpio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// version 1.0.0; Aug 13, 2015
+//
+//******************************************************************************
+
+#ifndef DEV_GPIO_SCHEDULER_H
+#define DEV_GPIO_SCHEDULER_H
+
+//_____ I N C L U D E S ________________________________________________________
+
+// ANSI C/C++ includes
+#include <vector>
+#include <pthread.h>
+
+// EPICS includes
+#include <epicsThread.h>
+#include <epicsTypes.h>
+
+// local includes
+#include "devGpio.h"
+
+//_____ D E F I N I T I O N S __________________________________________________
+
+//! @brief   Thread setting output lines at scheduled times
+//!
+//! Commands are kept in a queue ordered by their deadline (CLOCK_MONOTONIC,
+//! like the kernel timestamps of edge events). The thread sleeps until the
+//! earliest deadline and sets the lines of the command with a single ioctl.
+//! The difference between actual and requested time is reported as lateness.
+class GpioScheduler: public epicsThreadRunable {
+  public:
+    GpioScheduler( epicsUInt32 capacity );
+    virtual ~GpioScheduler();
+    GpioScheduler( GpioScheduler const& rother ); // Not implemented
+    GpioScheduler& operator=( GpioScheduler const& rother ); // Not implemented
+
+    virtual void run();
+
+    epicsThread thread;
+
+    bool schedule( devGpio_info_t* pinfo, epicsUInt64 deadline_ns, epicsUInt64 bits, epicsUInt64 mask );
+    void report();
+
+  private:
+
+    struct command_t {
+      epicsUInt64 deadline_ns;
+      epicsUInt64 seq;          //!< keeps commands with equal deadlines in order
+      devGpio_info_t* pinfo;
+      epicsUInt64 bits;
+      epicsUInt64 mask;
+      bool operator<( command_t const& other ) const {
+        return ( deadline_ns != other.deadline_ns ) ? deadline_ns > other.deadline_ns
+                                                    : seq > other.seq;
+      }
+    };
+
+    epicsUInt32 _capacity;
+    epicsUInt64 _seq;
+    std::vector<command_t> _queue;
+    pthread_mutex_t _lock;
+    pthread_cond_t _wakeup;
+
+    epicsUInt64 _nexecuted;
+    epicsUInt64 _nrejected;
+    epicsUInt64 _nerrors;
+    epicsInt64 _lastLate;
+    epicsInt64 _maxLate;
+    double _sumLate;
+};
+
+#endif
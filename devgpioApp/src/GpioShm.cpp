@@ -0,0 +1,155 @@
+//******************************************************************************
+// Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+//                    - Helmholtz-Institut Mainz
+//
+// This file is part of devGpio
+//
+// devGpio is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// devGpio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// version 1.0.0; Aug 13, 2015
+//
+//******************************************************************************
+
+//! @file GpioShm.cpp
+//! @brief Implementation of the shared-memory state snapshot
+
+//_____ I N C L U D E S ________________________________________________________
+
+// ANSI C/C++ includes
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+// EPICS includes
+
+// local includes
+#include "GpioShm.hpp"
+
+//_____ D E F I N I T I O N S __________________________________________________
+
+
+//_____ G L O B A L S __________________________________________________________
+
+//_____ L O C A L S ____________________________________________________________
+
+//_____ F U N C T I O N S ______________________________________________________
+
+//------------------------------------------------------------------------------
+//! @brief   Standard Constructor
+//------------------------------------------------------------------------------
+GpioShm::GpioShm()
+  : _size( 0 ),
+    _capacity( 0 ),
+    _header( nullptr ),
+    _entries( nullptr ),
+    _locks( nullptr )
+{}
+
+//------------------------------------------------------------------------------
+//! @brief   Standard Destructor
+//------------------------------------------------------------------------------
+GpioShm::~GpioShm() {
+  if( _header ) munmap( _header, _size );
+  if( _locks ) {
+    for( epicsUInt32 i = 0; i < _capacity; ++i ) pthread_mutex_destroy( &_locks[i] );
+    delete[] _locks;
+  }
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Create and map the shared-memory segment
+//!
+//! The segment is (re)initialized, readers attached to an old segment of
+//! the same name see the new contents.
+//!
+//! @param   [in]  name      Name of the segment, e.g. "/gpio"
+//! @param   [in]  capacity  Number of entries (size of the line request pool)
+//!
+//! @return  false in case of an error
+//------------------------------------------------------------------------------
+bool GpioShm::open( std::string const& name, epicsUInt32 capacity ) {
+  if( _header || 0 == capacity ) return false;
+
+  _name = ( '/' == name[0] ) ? name : "/" + name;
+  int fd = shm_open( _name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+  if( -1 == fd ) {
+    std::cerr << "GpioShm: Could not open " << _name << ": " << strerror( errno ) << std::endl;
+    return false;
+  }
+
+  _size = sizeof( GpioShmHeader ) + (size_t)capacity * sizeof( GpioShmEntry );
+  if( -1 == ftruncate( fd, _size ) ) {
+    std::cerr << "GpioShm: Could not resize " << _name << ": " << strerror( errno ) << std::endl;
+    ::close( fd );
+    return false;
+  }
+  void *addr = mmap( nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  ::close( fd );
+  if( MAP_FAILED == addr ) {
+    std::cerr << "GpioShm: Could not map " << _name << ": " << strerror( errno ) << std::endl;
+    return false;
+  }
+
+  // writers of different priorities share the entries, a preempted
+  // writer must not block a higher priority one forever
+  _locks = new pthread_mutex_t[capacity];
+  _capacity = capacity;
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init( &attr );
+  pthread_mutexattr_setprotocol( &attr, PTHREAD_PRIO_INHERIT );
+  for( epicsUInt32 i = 0; i < capacity; ++i ) pthread_mutex_init( &_locks[i], &attr );
+  pthread_mutexattr_destroy( &attr );
+
+  memset( addr, 0, _size );
+  _header = (GpioShmHeader*)addr;
+  _entries = (GpioShmEntry*)( _header + 1 );
+  memcpy( _header->magic, GPIO_SHM_MAGIC, sizeof( _header->magic ) );
+  _header->entrySize = sizeof( GpioShmEntry );
+  _header->capacity = capacity;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Describe the line request of an entry
+//!
+//! Called once per line request after the records have been initialized.
+//!
+//! @param   [in]  index    Index of the line request within the pool
+//! @param   [in]  name     Name of the record owning the line request
+//! @param   [in]  nlines   Number of requested lines
+//! @param   [in]  offsets  Offsets of the requested lines
+//------------------------------------------------------------------------------
+void GpioShm::describe( epicsUInt32 index, char const* name, epicsUInt32 nlines, epicsUInt32 const* offsets ) {
+  if( !_header || index >= _header->capacity ) return;
+  GpioShmEntry *e = lock( index );
+  strncpy( e->name, name, sizeof( e->name ) - 1 );
+  e->nlines = nlines;
+  memcpy( e->offsets, offsets, nlines * sizeof( offsets[0] ) );
+  e->update_ns = now();
+  unlock( e );
+  if( index >= _header->used ) __atomic_store_n( &_header->used, index + 1, __ATOMIC_RELEASE );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Print status of the segment
+//------------------------------------------------------------------------------
+void GpioShm::report() const {
+  if( !_header ) return;
+  std::cout << "  shared memory " << _name << ": " << _header->used << " of "
+            << _header->capacity << " entries, " << _size << " bytes" << std::endl;
+}
@@ -0,0 +1,109 @@
+//******************************************************************************
+// Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+//                    - Helmholtz-Institut Mainz
+//
+// This file is part of devGpio
+//
+// devGpio is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// devGpio is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+// version 1.0.0; Aug 13, 2015
+//
+//******************************************************************************
+
+#ifndef DEV_GPIO_SHM_H
+#define DEV_GPIO_SHM_H
+
+//_____ I N C L U D E S ________________________________________________________
+
+// ANSI C/C++ includes
+#include <string>
+#include <pthread.h>
+#include <time.h>
+
+// EPICS includes
+#include <epicsTypes.h>
+
+// local includes
+#include "devGpioShm.h"
+
+//_____ D E F I N I T I O N S __________________________________________________
+
+//! @brief   Snapshot of all line requests in POSIX shared memory
+//!
+//! Local processes read the state of the lines without Channel Access and
+//! without requesting the lines themselves. Entries are written by the
+//! interrupt threads, the scheduler and the read/write routines of the
+//! records. Writers of an entry are serialized by a priority inheriting
+//! mutex, the sequence lock only protects the readers. The layout of the
+//! segment is given in devGpioShm.h.
+class GpioShm {
+  public:
+    GpioShm();
+    virtual ~GpioShm();
+    GpioShm( GpioShm const& rother ); // Not implemented
+    GpioShm& operator=( GpioShm const& rother ); // Not implemented
+
+    bool open( std::string const& name, epicsUInt32 capacity );
+    void describe( epicsUInt32 index, char const* name, epicsUInt32 nlines, epicsUInt32 const* offsets );
+    void report() const;
+
+    //! @brief   Update the levels of some lines
+    inline void levels( epicsUInt32 index, epicsUInt64 bits, epicsUInt64 mask ) {
+      GpioShmEntry *e = lock( index );
+      e->levels = ( e->levels & ~mask ) | ( bits & mask );
+      e->update_ns = now();
+      unlock( e );
+    }
+
+    //! @brief   Update the state after edge events have been read
+    inline void edges( epicsUInt32 index, epicsUInt64 bits, epicsUInt64 nevents, epicsUInt64 event_ns ) {
+      GpioShmEntry *e = lock( index );
+      e->levels = bits;
+      e->nevents = nevents;
+      e->event_ns = event_ns;
+      e->update_ns = now();
+      unlock( e );
+    }
+
+  private:
+
+    inline GpioShmEntry* lock( epicsUInt32 index ) {
+      pthread_mutex_lock( &_locks[index] );
+      GpioShmEntry *e = &_entries[index];
+      __atomic_store_n( &e->seq, e->seq + 1, __ATOMIC_RELAXED );
+      __atomic_thread_fence( __ATOMIC_RELEASE );
+      return e;
+    }
+
+    inline void unlock( GpioShmEntry* e ) {
+      __atomic_store_n( &e->seq, e->seq + 1, __ATOMIC_RELEASE );
+      pthread_mutex_unlock( &_locks[e - _entries] );
+    }
+
+    static inline epicsUInt64 now() {
+      struct timespec ts;
+      clock_gettime( CLOCK_MONOTONIC, &ts );
+      return (epicsUInt64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    std::string _name;
+    size_t _size;
+    epicsUInt32 _capacity;
+    GpioShmHeader* _header;
+    GpioShmEntry* _entries;
+    pthread_mutex_t* _locks;  //!< One writer lock per entry, process local
+};
+
+#endif
@@ -30,9 +30,13 @@
 //_____ I N C L U D E S ________________________________________________________
 
 // ANSI C/C++ includes
+#include <algorithm>
 #include <cstring>
 #include <cerrno>
+#include <cstdlib>
+#include <ctime>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -53,15 +57,53 @@
 
 // local includes
 #include "devGpio.h"
+#include "GpioCoincidence.hpp"
 #include "GpioIntHandler.hpp"
+#include "GpioRecorder.hpp"
+#include "GpioReflex.hpp"
+#include "GpioScheduler.hpp"
+#include "GpioShm.hpp"
 
 //_____ D E F I N I T I O N S __________________________________________________
 
+//! Configuration of an additional group of the interrupt handler
+struct GpioIntGroup {
+  std::string name;
+  unsigned int priority;
+  std::string cpus;
+};
+
 //_____ G L O B A L S __________________________________________________________
 
+//! Number of entries in the pool of private device data (one per line request)
+int devGpioPoolSize = 256;
+
+//! Maximum number of pending time-tagged output commands
+int devGpioQueueSize = 1024;
+
+//! Maximum edge rate (per second) of a line request before edge detection is disabled, 0 = no limit
+int devGpioStormRate = 50000;
+
+//! Time in seconds the levels have to be stable before edge detection is enabled again
+double devGpioStormQuiet = 1.;
+
+//! Priority of the sampling threads
+int devGpioSamplerPriority = epicsThreadPriorityMedium;
+
 //_____ L O C A L S ____________________________________________________________
-static GpioIntHandler* intHandler = nullptr;
+static std::vector<GpioIntGroup> intGroups;
+static std::vector<GpioIntHandler*> intHandlers; // index is devGpio_info_t::group
 static int gpiochip = -1;
+static GpioReflex* reflex = nullptr;
+static GpioCoincidence* coincidence = nullptr;
+static GpioScheduler* scheduler = nullptr;
+static std::map<epicsUInt32, std::string> triggerNames; // pool index -> TRIGGER record
+static GpioRecorder* recorder = nullptr;
+static std::string shmName;
+static GpioShm* shm = nullptr;
+static devGpio_info_t* linePool = nullptr;
+static devGpio_cold_t* linePoolCold = nullptr;
+static epicsUInt32 linePoolUsed = 0;
 
 //_____ F U N C T I O N S ______________________________________________________
 
@@ -85,6 +127,29 @@ static bool is_number( std::string const& s ) {
   return !s.empty() && s.find_first_not_of("0123456789") == std::string::npos;
 }
 
+//------------------------------------------------------------------------------
+//! @brief   Convert a publish rate in Hz into a period in ns
+//------------------------------------------------------------------------------
+static epicsUInt64 rate2period( double rate ) {
+  return ( 0. < rate ) ? (epicsUInt64)( 1e9 / rate ) : 0;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Get value of a "KEY=value" option
+//!
+//! @param   [in]  opt    Option as given in the INP/OUT field
+//! @param   [in]  key    Name of the option
+//! @param   [out] value  Value of the option
+//!
+//! @return  true if the option has the given name
+//------------------------------------------------------------------------------
+static bool option_value( std::string const& opt, std::string const& key, std::string& value ) {
+  if( opt.size() <= key.size() || '=' != opt[key.size()] ) return false;
+  if( !iequals( opt.substr( 0, key.size() ), key ) ) return false;
+  value = opt.substr( key.size() + 1 );
+  return true;
+}
+
 //------------------------------------------------------------------------------
 //! @brief   Initialization of device support
 //!
@@ -103,7 +168,35 @@ long devGpioInit( int after ) {
     firstRunBefore = false;
 
     if( 0 <= gpiochip ) {
-      intHandler = new GpioIntHandler();
+      if( 0 >= devGpioPoolSize
+          || 0 != posix_memalign( (void**)&linePool, DEVGPIO_CACHELINE,
+                                  devGpioPoolSize * sizeof( devGpio_info_t ) )
+          || !( linePoolCold = (devGpio_cold_t*)calloc( devGpioPoolSize, sizeof( devGpio_cold_t ) ) ) ) {
+        std::cerr << "devGpio: Could not allocate pool for " << devGpioPoolSize
+                  << " line requests" << std::endl;
+        free( linePool );
+        linePool = nullptr;
+        close( gpiochip );
+        gpiochip = -1;
+        return ERROR;
+      }
+      memset( linePool, 0, devGpioPoolSize * sizeof( devGpio_info_t ) );
+      for( int i = 0; i < devGpioPoolSize; ++i ) linePool[i].cold = &linePoolCold[i];
+      if( !shmName.empty() ) {
+        shm = new GpioShm();
+        if( !shm->open( shmName, devGpioPoolSize ) ) {
+          delete shm;
+          shm = nullptr;
+        }
+      }
+      intHandlers.push_back( new GpioIntHandler( "", 50, "", linePool, devGpioPoolSize ) );
+      for( auto const& g : intGroups )
+        intHandlers.push_back( new GpioIntHandler( g.name, g.priority, g.cpus, linePool, devGpioPoolSize ) );
+      for( auto h : intHandlers ) {
+        h->setRecorder( recorder );
+        h->setShm( shm );
+        h->setStormLimit( devGpioStormRate, devGpioStormQuiet );
+      }
     }
   } else {
     // after records have been initialized
@@ -112,7 +205,17 @@ long devGpioInit( int after ) {
 
     if( 0 <= gpiochip ) {
       close( gpiochip );
-      intHandler->thread.start();
+      if( reflex ) reflex->resolve( linePool, linePoolUsed, intHandlers );
+      if( coincidence ) coincidence->resolve( linePool, linePoolUsed, intHandlers );
+      for( auto const& t : triggerNames ) {
+        linePool[t.first].cold->trigger = devGpioLookupTrigger( t.second.c_str() );
+      }
+      if( scheduler ) scheduler->thread.start();
+      for( epicsUInt32 i = 0; shm && i < linePoolUsed; ++i ) {
+        shm->describe( i, linePool[i].prec->name, linePool[i].nlines, linePool[i].cold->offsets );
+        shm->levels( i, linePool[i].levels, devGpioMask( linePool[i].nlines ) );
+      }
+      for( auto h : intHandlers ) h->thread.start();
     }
   }
 
@@ -144,11 +247,18 @@ epicsUInt16 devGpioInitRecord( dbCommon *prec, devGpio_rec_t* pconf ){
 
   if( options.empty() ) {
     std::cerr << prec->name << ": Invalid INP/OUT field: " << ss.str() << "\n"
-              << "    Syntax is \"@<GPIO1> [GPIO2] [LOW] [FALLING/RISING/BOTH]\"" << std::endl;
+              << "    Syntax is \"@<GPIO1> [GPIO2] [LOW] [FALLING/RISING/BOTH] [SHARED] [MAXRATE=<Hz>]\"" << std::endl;
     return ERROR;
   }
 
   std::vector<epicsUInt32> gpios;
+  bool shared = pconf->shared;
+  epicsUInt8 group = 0;
+  epicsInt64 delay_ns = -1;
+  std::string trigger;
+  bool fast = false;
+  bool output = ( DEVGPIO_MODE_LEVELS == pconf->mode && ( pconf->flags & GPIO_V2_LINE_FLAG_OUTPUT ) );
+  std::string value;
   for( auto opt : options ){
     if( iequals( opt, "low" ) || iequals( opt, "l" ) ) {
       pconf->flags |= GPIO_V2_LINE_FLAG_ACTIVE_LOW;
@@ -158,6 +268,67 @@ epicsUInt16 devGpioInitRecord( dbCommon *prec, devGpio_rec_t* pconf ){
       pconf->flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
     } else if( iequals( opt, "both" ) || iequals( opt, "b" ) ) {
       pconf->flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING | GPIO_V2_LINE_FLAG_EDGE_RISING;
+    } else if( iequals( opt, "shared" ) || iequals( opt, "s" ) ) {
+      shared = true;
+    } else if( ( ( DEVGPIO_MODE_QUAD == pconf->mode || DEVGPIO_MODE_SAMPLER == pconf->mode
+                   || DEVGPIO_MODE_PULSE == pconf->mode ) && option_value( opt, "rate", value ) )
+               || ( DEVGPIO_MODE_LEVELS == pconf->mode && option_value( opt, "maxrate", value ) ) ) {
+      char *end;
+      pconf->rate = strtod( value.c_str(), &end );
+      // pulse statistics need a window, a rate of 0 would publish every edge
+      if( *end || 0. > pconf->rate || ( DEVGPIO_MODE_PULSE == pconf->mode && 0. == pconf->rate ) ) {
+        std::cerr << prec->name << ": Invalid rate: " << value << std::endl;
+        return ERROR;
+      }
+    } else if( pconf->post && iequals( opt, "fast" ) ) {
+      fast = true;
+    } else if( option_value( opt, "group", value ) ) {
+      epicsUInt8 i = 0;
+      while( i < intHandlers.size() && !iequals( intHandlers[i]->name(), value ) ) ++i;
+      if( 0 == i || i == intHandlers.size() ) {
+        std::cerr << prec->name << ": Unknown group: " << value << std::endl;
+        return ERROR;
+      }
+      group = i;
+    } else if( output && option_value( opt, "delay", value ) ) {
+      char *end;
+      double delay = strtod( value.c_str(), &end );
+      if( *end || 0. > delay ) {
+        std::cerr << prec->name << ": Invalid delay: " << value << std::endl;
+        return ERROR;
+      }
+      delay_ns = (epicsInt64)( delay * 1e3 );
+    } else if( output && option_value( opt, "trigger", value ) ) {
+      trigger = value;
+    } else if( DEVGPIO_MODE_PULSE == pconf->mode && option_value( opt, "measure", value ) ) {
+      if( iequals( value, "high" ) )        pconf->quantity = DEVGPIO_PULSE_HIGH;
+      else if( iequals( value, "low" ) )    pconf->quantity = DEVGPIO_PULSE_LOW;
+      else if( iequals( value, "period" ) ) pconf->quantity = DEVGPIO_PULSE_PERIOD;
+      else if( iequals( value, "duty" ) )   pconf->quantity = DEVGPIO_PULSE_DUTY;
+      else {
+        std::cerr << prec->name << ": Invalid quantity: " << value << std::endl;
+        return ERROR;
+      }
+    } else if( DEVGPIO_MODE_PULSE == pconf->mode && option_value( opt, "stat", value ) ) {
+      if( iequals( value, "mean" ) )     pconf->stat = DEVGPIO_STAT_MEAN;
+      else if( iequals( value, "min" ) ) pconf->stat = DEVGPIO_STAT_MIN;
+      else if( iequals( value, "max" ) ) pconf->stat = DEVGPIO_STAT_MAX;
+      else {
+        std::cerr << prec->name << ": Invalid statistic: " << value << std::endl;
+        return ERROR;
+      }
+    } else if( DEVGPIO_MODE_SHIFT == pconf->mode && option_value( opt, "bits", value ) ) {
+      if( !is_number( value ) || 0 == std::stoul( value ) ) {
+        std::cerr << prec->name << ": Invalid number of bits: " << value << std::endl;
+        return ERROR;
+      }
+      pconf->nbits = std::stoul( value );
+    } else if( DEVGPIO_MODE_SHIFT == pconf->mode && iequals( opt, "lsb" ) ) {
+      pconf->lsb = true;
+    } else if( DEVGPIO_MODE_SHIFT == pconf->mode && iequals( opt, "msb" ) ) {
+      pconf->lsb = false;
+    } else if( DEVGPIO_MODE_SHIFT == pconf->mode && !pconf->outonly && iequals( opt, "in" ) ) {
+      pconf->inmask = 1;
     } else if( is_number( opt )) {
       gpios.push_back( std::stoi( opt ));
     } else {
@@ -166,6 +337,55 @@ epicsUInt16 devGpioInitRecord( dbCommon *prec, devGpio_rec_t* pconf ){
     }
   }
 
+  if( 0. < pconf->rate && DEVGPIO_MODE_SAMPLER != pconf->mode
+      && !( pconf->flags & ( GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING ) ) ) {
+    std::cerr << prec->name << ": Publish rate requires edge detection" << std::endl;
+    return ERROR;
+  }
+
+  if( fast && ( shared || !( pconf->flags & ( GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING ) ) ) ) {
+    std::cerr << prec->name << ": FAST requires edge detection and cannot be shared" << std::endl;
+    return ERROR;
+  }
+
+  // the transfer or sampler state of the record is kept in the line request
+  if( shared && ( DEVGPIO_MODE_SHIFT == pconf->mode || DEVGPIO_MODE_SAMPLER == pconf->mode ) ) {
+    std::cerr << prec->name << ": SHARED is not supported by this device support" << std::endl;
+    return ERROR;
+  }
+
+  if( gpios.size() > GPIO_V2_LINES_MAX ) {
+    std::cerr << prec->name << ": Too many gpio lines: " << gpios.size() << std::endl;
+    return ERROR;
+  }
+
+  // Shared line requests are reused by all records with the same configuration
+  if( shared ) {
+    for( epicsUInt32 i = 0; i < linePoolUsed; ++i ) {
+      devGpio_info_t *pinfo = &linePool[i];
+      if( !pinfo->shared || pinfo->cold->flags != pconf->flags || pinfo->nlines != gpios.size() ) continue;
+      if( pinfo->mode != pconf->mode || pinfo->period_ns != rate2period( pconf->rate ) ) continue;
+      if( pinfo->group != group ) continue;
+      if( pinfo->cold->scheduled != ( 0 <= delay_ns || !trigger.empty() ) ) continue;
+      if( pinfo->cold->delay_ns != (epicsUInt64)std::max( delay_ns, (epicsInt64)0 ) ) continue;
+      auto t = triggerNames.find( i );
+      if( ( triggerNames.end() == t ? std::string() : t->second ) != trigger ) continue;
+      if( !std::equal( gpios.begin(), gpios.end(), pinfo->cold->offsets ) ) continue;
+      pinfo->cold->nrecs++;
+      if( pconf->arm ) intHandlers[pinfo->group]->registerInterrupt( pinfo );
+      prec->dpvt = pinfo;
+      return pinfo->nlines;
+    }
+  }
+
+  if( linePoolUsed >= (epicsUInt32)devGpioPoolSize ) {
+    std::cerr << prec->name << ": No free entry in pool of line requests, "
+              << "increase devGpioPoolSize (" << devGpioPoolSize << ")" << std::endl;
+    return ERROR;
+  }
+
+  if( ( 0 <= delay_ns || !trigger.empty() ) && OK != devGpioSchedulerInit() ) return ERROR;
+
   struct gpio_v2_line_request req;
   memset( &req, 0, sizeof( req ));
   strcpy( req.consumer, "EPICS devGpio" );
@@ -188,6 +408,12 @@ epicsUInt16 devGpioInitRecord( dbCommon *prec, devGpio_rec_t* pconf ){
   }
   req.num_lines = nobt;
   req.config.flags = pconf->flags;
+  if( 0 != pconf->inmask ) {
+    req.config.num_attrs = 1;
+    req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+    req.config.attrs[0].attr.flags = ( pconf->flags & GPIO_V2_LINE_FLAG_ACTIVE_LOW ) | GPIO_V2_LINE_FLAG_INPUT;
+    req.config.attrs[0].mask = pconf->inmask;
+  }
 
   int rtn = ioctl( gpiochip, GPIO_V2_GET_LINE_IOCTL, &req );
   if( -1 == rtn ) {
@@ -195,11 +421,46 @@ epicsUInt16 devGpioInitRecord( dbCommon *prec, devGpio_rec_t* pconf ){
     return ERROR;
   }
 
-  devGpio_info_t *pinfo = new devGpio_info_t;
+  // edge events are read by the interrupt handler without blocking
+  fcntl( req.fd, F_SETFL, fcntl( req.fd, F_GETFL ) | O_NONBLOCK );
+
+  devGpio_info_t *pinfo = &linePool[linePoolUsed];
   pinfo->fd = req.fd;
-  pinfo->pcallback = nullptr;
+  pinfo->index = linePoolUsed++;
+  pinfo->prec = prec;
+  pinfo->cold->flags = pconf->flags;
+  pinfo->cold->inmask = pconf->inmask;
+  pinfo->shared = shared;
+  pinfo->mode = pconf->mode;
+  pinfo->group = group;
+  pinfo->period_ns = rate2period( pconf->rate );
+  pinfo->cold->nrecs = 1;
+  if( fast ) pinfo->post = pconf->post;
+  pinfo->nlines = nobt;
+  std::copy( gpios.begin(), gpios.end(), pinfo->cold->offsets );
+
+  if( 0 <= delay_ns || !trigger.empty() ) {
+    pinfo->cold->scheduled = true;
+    pinfo->cold->delay_ns = std::max( delay_ns, (epicsInt64)0 );
+    if( !trigger.empty() ) triggerNames[pinfo->index] = trigger;
+  }
+
+  if( pconf->flags & ( GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING ) ) {
+    // initial levels, kept up to date by the edge events afterwards
+    struct gpio_v2_line_values values = { 0, devGpioMask( nobt ) };
+    if( -1 == ioctl( pinfo->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values ) ) {
+      std::cerr << prec->name << ": Could not read gpio lines: " << strerror( errno ) << std::endl;
+    }
+    pinfo->levels = values.bits;
+  }
+
+  // decoding and counting need every edge, independent of the records' SCAN
+  if( pconf->arm ) intHandlers[group]->registerInterrupt( pinfo );
 
   // I/O Intr handling
+  callbackSetCallback( devGpioCallback, &pinfo->callback );
+  callbackSetUser( (void*)prec, &pinfo->callback );
+  callbackSetPriority( priorityLow, &pinfo->callback );
   scanIoInit( &pinfo->ioscanpvt );
 
   prec->dpvt = pinfo;
@@ -207,6 +468,35 @@ epicsUInt16 devGpioInitRecord( dbCommon *prec, devGpio_rec_t* pconf ){
   return nobt;
 }
 
+//------------------------------------------------------------------------------
+//! @brief   Undo devGpioInitRecord of a record which failed its own checks
+//!
+//! Drops the record from its line request. The line request of the last
+//! record is closed and its pool entry, which is the last one taken, is
+//! returned together with the data of the mode in ext.
+//!
+//! @param   [in]  prec       Address of the record calling this function
+//! @param   [in]  pconf      Address of record configuration
+//------------------------------------------------------------------------------
+void devGpioReleaseRecord( dbCommon *prec, devGpio_rec_t const* pconf ) {
+  devGpio_info_t *pinfo = (devGpio_info_t *)prec->dpvt;
+  if( !pinfo ) return;
+  prec->dpvt = nullptr;
+
+  if( pconf->arm ) intHandlers[pinfo->group]->cancelInterrupt( pinfo );
+  if( 0 != --pinfo->cold->nrecs ) return;
+
+  close( pinfo->fd );
+  triggerNames.erase( pinfo->index );
+  free( pinfo->ext );
+  if( pinfo->index + 1 == linePoolUsed ) --linePoolUsed;
+  devGpio_cold_t *cold = pinfo->cold;
+  memset( cold, 0, sizeof( devGpio_cold_t ) );
+  memset( pinfo, 0, sizeof( devGpio_info_t ) );
+  pinfo->cold = cold;
+  pinfo->fd = -1;
+}
+
 //------------------------------------------------------------------------------
 //! @brief   Get I/O Intr Information of record
 //!
@@ -217,12 +507,28 @@ epicsUInt16 devGpioInitRecord( dbCommon *prec, devGpio_rec_t* pconf ){
 //! @return  ERROR in case of an error, otherwise OK
 //------------------------------------------------------------------------------
 long devGpioGetIoIntInfo( int cmd, dbCommon *prec, IOSCANPVT *ppvt ){
-  devGpio_info_t *pinfo = (devGpio_info_t *)prec->dpvt;
+  return devGpioIoIntInfo( cmd, (devGpio_info_t *)prec->dpvt, ppvt );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Get I/O Intr scan list of a line request
+//!
+//! Used by device supports whose private data is not the line request.
+//!
+//! @param   [in]  cmd    0 if record is placed in, 1 if removed from the list
+//! @param   [in]  pinfo  Address of the private data of the line request
+//! @param   [out] ppvt   Address of the IOSCANPVT structure
+//!
+//! @return  In case of error return -1, otherwise return 0
+//------------------------------------------------------------------------------
+long devGpioIoIntInfo( int cmd, devGpio_info_t *pinfo, IOSCANPVT *ppvt ){
   *ppvt = pinfo->ioscanpvt;
   if ( 0 == cmd ) {
-    intHandler->registerInterrupt( prec );
+    pinfo->nintr++;
+    intHandlers[pinfo->group]->registerInterrupt( pinfo );
   } else {
-    intHandler->cancelInterrupt( pinfo );
+    pinfo->nintr--;
+    intHandlers[pinfo->group]->cancelInterrupt( pinfo );
   }
   return OK;
 }
@@ -243,6 +549,234 @@ void devGpioCallback( CALLBACK *pcallback ) {
   dbScanUnlock( prec );
 }
 
+//------------------------------------------------------------------------------
+//! @brief   Raise an alarm while edge detection is disabled by an interrupt storm
+//!
+//! Called by the read routines of records using edge events.
+//!
+//! @param   [in]  prec   Address of the record
+//! @param   [in]  pinfo  Address of the private data structure
+//------------------------------------------------------------------------------
+void devGpioStormAlarm( dbCommon *prec, devGpio_info_t const* pinfo ) {
+  if( __atomic_load_n( &pinfo->throttled, __ATOMIC_RELAXED ) )
+    recGblSetSevr( prec, HW_LIMIT_ALARM, MAJOR_ALARM );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Publish levels of a line request to the shared-memory snapshot
+//!
+//! Called by read and write routines after the lines have been accessed.
+//!
+//! @param   [in]  pinfo  Address of the private data structure
+//! @param   [in]  bits   Levels of the lines
+//! @param   [in]  mask   Lines which have been read or written
+//------------------------------------------------------------------------------
+void devGpioShmLevels( devGpio_info_t const* pinfo, epicsUInt64 bits, epicsUInt64 mask ) {
+  if( shm ) shm->levels( pinfo->index, bits, mask );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Create the scheduler of time-tagged outputs
+//!
+//! Called during record initialization by all users of the scheduler.
+//!
+//! @return  In case of error return -1, otherwise return 0
+//------------------------------------------------------------------------------
+long devGpioSchedulerInit( void ) {
+  if( scheduler ) return OK;
+  if( 0 >= devGpioQueueSize ) {
+    std::cerr << "devGpio: Invalid size of the output queue: " << devGpioQueueSize << std::endl;
+    return ERROR;
+  }
+  scheduler = new GpioScheduler( devGpioQueueSize );
+  return OK;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Find the line request of a devGpio record
+//!
+//! @param   [in]  name  Name of the record
+//!
+//! @return  Address of the private data, NULL in case of an error
+//------------------------------------------------------------------------------
+devGpio_info_t* devGpioLookup( char const* name ) {
+  epicsUInt64 mask;
+  return GpioReflex::lookup( name, &mask, linePool, linePoolUsed );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Find and arm the line request of a trigger record
+//!
+//! The edges of the trigger are watched independent of its SCAN, so the
+//! timestamp of its last edge is always up to date.
+//!
+//! @param   [in]  name  Name of the record
+//!
+//! @return  Address of the private data, NULL in case of an error
+//------------------------------------------------------------------------------
+devGpio_info_t* devGpioLookupTrigger( char const* name ) {
+  devGpio_info_t *ptrig = devGpioLookup( name );
+  if( !ptrig ) return nullptr;
+  if( !( ptrig->cold->flags & ( GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING ) ) ) {
+    std::cerr << "devGpio: Trigger " << name << " requires edge detection" << std::endl;
+    return nullptr;
+  }
+  intHandlers[ptrig->group]->registerInterrupt( ptrig );
+  return ptrig;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Time scheduled commands are relative to
+//!
+//! @param   [in]  trigger  Line request whose last edge is used, NULL for now
+//!
+//! @return  Time in ns (CLOCK_MONOTONIC), 0 if the trigger has not fired yet
+//------------------------------------------------------------------------------
+epicsUInt64 devGpioScheduleBase( devGpio_info_t const* trigger ) {
+  if( trigger ) return __atomic_load_n( &trigger->trigger_ns, __ATOMIC_ACQUIRE );
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (epicsUInt64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Queue a command setting output lines
+//!
+//! @param   [in]  pinfo        Address of the private data structure
+//! @param   [in]  deadline_ns  Time to set the lines (CLOCK_MONOTONIC)
+//! @param   [in]  bits         Levels of the lines
+//! @param   [in]  mask         Lines to set
+//!
+//! @return  In case of error return -1, otherwise return 0
+//------------------------------------------------------------------------------
+long devGpioSchedule( devGpio_info_t* pinfo, epicsUInt64 deadline_ns, epicsUInt64 bits, epicsUInt64 mask ) {
+  if( !scheduler || !scheduler->schedule( pinfo, deadline_ns, bits, mask ) ) {
+    std::cerr << pinfo->prec->name << ": Output queue full" << std::endl;
+    return ERROR;
+  }
+  return OK;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Queue a write of a record with DELAY and/or TRIGGER option
+//!
+//! @param   [in]  pinfo  Address of the private data structure
+//! @param   [in]  bits   Levels of the lines
+//! @param   [in]  mask   Lines to set
+//!
+//! @return  In case of error return -1, otherwise return 0
+//------------------------------------------------------------------------------
+long devGpioScheduleWrite( devGpio_info_t* pinfo, epicsUInt64 bits, epicsUInt64 mask ) {
+  if( !pinfo->cold->trigger && triggerNames.count( pinfo->index ) ) {
+    std::cerr << pinfo->prec->name << ": Trigger " << triggerNames.at( pinfo->index )
+              << " not available" << std::endl;
+    return ERROR;
+  }
+  epicsUInt64 base = devGpioScheduleBase( pinfo->cold->trigger );
+  if( 0 == base ) {
+    std::cerr << pinfo->prec->name << ": Trigger " << pinfo->cold->trigger->prec->name
+              << " has not fired yet" << std::endl;
+    return ERROR;
+  }
+  return devGpioSchedule( pinfo, base + pinfo->cold->delay_ns, bits, mask );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Find a coincidence rule
+//!
+//! @param   [in]  name  Name of the rule
+//!
+//! @return  Address of the rule, NULL if not found
+//------------------------------------------------------------------------------
+void* devGpioCoincFind( char const* name ) {
+  if( !coincidence || !name ) return nullptr;
+  return coincidence->find( name );
+}
+
+//------------------------------------------------------------------------------
+//! @brief   I/O Intr scan list of a coincidence rule, triggered on matches
+//------------------------------------------------------------------------------
+IOSCANPVT devGpioCoincScan( void* prule ) {
+  return static_cast<GpioCoincidence::rule_t*>( prule )->ioscanpvt;
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Raise the storm alarm if an input of a coincidence rule is throttled
+//!
+//! @param   [in]  prec   Address of the record
+//! @param   [in]  prule  Address of the rule
+//------------------------------------------------------------------------------
+void devGpioCoincStormAlarm( dbCommon *prec, void* prule ) {
+  GpioCoincidence::rule_t *r = static_cast<GpioCoincidence::rule_t*>( prule );
+  for( auto const& in : r->inputs ) {
+    if( in.pinfo ) devGpioStormAlarm( prec, in.pinfo );
+  }
+}
+
+//------------------------------------------------------------------------------
+//! @brief   Read the state of a coincidence rule
+//!
+//! @param   [in]  prule        Address of the rule
+//! @param   [out] ncoinc       Number of coincidences, including violations
+//! @param   [out] nviolations  Number of order violations
+//! @param   [out] delta_ns     Time from first to second edge of the last match
+//! @param   [out] inorder      Last match was in order
+//------------------------------------------------------------------------------
+void devGpioCoincRead( void* prule, epicsUInt64* ncoinc, epicsUInt64* nviolations,
+                       epicsInt64* delta_ns, epicsUInt8* inorder ) {
+  GpioCoincidence::rule_t *r = static_cast<GpioCoincidence::rule_t*>( prule );
+  r->lock.lock();
+  *ncoinc = r->ncoinc;
+  *nviolations = r->nviolations;
+  *delta_ns = r->delta_ns;
+  *inorder = r->inorder;
+  r->lock.unlock();
+}
+
+
+//------------------------------------------------------------------------------
+//! @brief   Print status of all line requests
+//!
+//! @param   [in]  level  Interest level, > 0 also prints the last edge event
+//------------------------------------------------------------------------------
+static void devGpioReport( int level ) {
+  std::cout << "devGpio: " << linePoolUsed << " of " << devGpioPoolSize
+            << " line requests in use" << std::endl;
+  for( epicsUInt32 i = 0; i < linePoolUsed; ++i ) {
+    devGpio_info_t const& info = linePool[i];
+    std::cout << "  " << info.prec->name << ": events " << info.nevents
+              << ", lost " << info.nlost;
+    if( info.shared ) std::cout << ", shared by " << info.cold->nrecs << " records";
+    if( 0 != info.group ) std::cout << ", group " << intHandlers[info.group]->name();
+    if( 0 != info.cold->nstorms ) std::cout << ", storms " << info.cold->nstorms << ( info.throttled ? " (throttled)" : "" );
+    if( DEVGPIO_MODE_QUAD == info.mode && info.ext ) {
+      devGpio_quad_t *pquad = (devGpio_quad_t*)info.ext;
+      std::cout << ", position " << pquad->position << ( pquad->stale ? " (stale)" : "" )
+                << ", missed edges " << pquad->nerrors;
+    }
+    if( DEVGPIO_MODE_SAMPLER == info.mode ) devGpioSamplerReport( &info );
+    if( DEVGPIO_MODE_PULSE == info.mode && info.ext ) {
+      devGpio_pulse_t *ppulse = (devGpio_pulse_t*)info.ext;
+      epicsMutexLock( ppulse->lock );
+      std::cout << ", period " << ppulse->pub[DEVGPIO_PULSE_PERIOD][DEVGPIO_STAT_MEAN]
+                << " us, duty " << ppulse->pub[DEVGPIO_PULSE_DUTY][DEVGPIO_STAT_MEAN]
+                << " % (" << ppulse->pubN[DEVGPIO_PULSE_PERIOD] << " pulses)";
+      epicsMutexUnlock( ppulse->lock );
+    }
+    std::cout << std::endl;
+    if( 0 < level && 0 != info.nevents ) {
+      std::cout << "    last event: line " << info.event.offset
+                << ( GPIO_V2_LINE_EVENT_RISING_EDGE == info.event.id ? " rising" : " falling" )
+                << ", timestamp " << info.event.timestamp_ns << " ns"
+                << ", seqno " << info.event.seqno << std::endl;
+    }
+  }
+  if( reflex ) reflex->report();
+  if( coincidence ) coincidence->report();
+  if( scheduler ) scheduler->report();
+  if( recorder ) recorder->report();
+  if( shm ) shm->report();
+}
 
 extern "C" {
 
@@ -257,14 +791,167 @@ extern "C" {
     }
   }
 
+  static iocshArg const GpioReportArg0 = { "level", iocshArgInt };
+  static iocshArg const* const GpioReportArgs[] = { &GpioReportArg0 };
+  static iocshFuncDef const GpioReportFuncDef = { "GpioReport", 1, GpioReportArgs };
+
+  static void GpioReportCallFunc( iocshArgBuf const *args ) {
+    devGpioReport( args[0].ival );
+  }
+
+  static iocshArg const GpioReflexArg0 = { "output", iocshArgString };
+  static iocshArg const GpioReflexArg1 = { "operation", iocshArgString };
+  static iocshArg const GpioReflexArg2 = { "inputs", iocshArgString };
+  static iocshArg const* const GpioReflexArgs[] = { &GpioReflexArg0, &GpioReflexArg1, &GpioReflexArg2 };
+  static iocshFuncDef const GpioReflexFuncDef = { "GpioReflex", 3, GpioReflexArgs };
+
+  static void GpioReflexCallFunc( iocshArgBuf const *args ) {
+    if( !args[0].sval || !args[1].sval || !args[2].sval ) {
+      std::cerr << "Usage: GpioReflex( <output>, <AND/OR/XOR/LATCH>, \"<input1> [input2] ...\" )" << std::endl;
+      return;
+    }
+    if( !reflex ) reflex = new GpioReflex();
+    reflex->add( args[0].sval, args[1].sval, args[2].sval );
+  }
+
+  static iocshArg const GpioReflexResetArg0 = { "output", iocshArgString };
+  static iocshArg const* const GpioReflexResetArgs[] = { &GpioReflexResetArg0 };
+  static iocshFuncDef const GpioReflexResetFuncDef = { "GpioReflexReset", 1, GpioReflexResetArgs };
+
+  static void GpioReflexResetCallFunc( iocshArgBuf const *args ) {
+    if( !reflex || !args[0].sval ) return;
+    reflex->reset( args[0].sval );
+  }
+
+  static iocshArg const GpioCoincidenceArg0 = { "name", iocshArgString };
+  static iocshArg const GpioCoincidenceArg1 = { "first", iocshArgString };
+  static iocshArg const GpioCoincidenceArg2 = { "second", iocshArgString };
+  static iocshArg const GpioCoincidenceArg3 = { "window_us", iocshArgDouble };
+  static iocshArg const GpioCoincidenceArg4 = { "ordered", iocshArgInt };
+  static iocshArg const* const GpioCoincidenceArgs[] = { &GpioCoincidenceArg0, &GpioCoincidenceArg1,
+                                                         &GpioCoincidenceArg2, &GpioCoincidenceArg3,
+                                                         &GpioCoincidenceArg4 };
+  static iocshFuncDef const GpioCoincidenceFuncDef = { "GpioCoincidence", 5, GpioCoincidenceArgs };
+
+  static void GpioCoincidenceCallFunc( iocshArgBuf const *args ) {
+    if( !args[0].sval || !args[1].sval || !args[2].sval ) {
+      std::cerr << "Usage: GpioCoincidence( <name>, <first input>, <second input>, <window in us>, <ordered 1/0> )" << std::endl;
+      return;
+    }
+    if( !coincidence ) coincidence = new GpioCoincidence();
+    coincidence->add( args[0].sval, args[1].sval, args[2].sval, args[3].dval, 0 != args[4].ival );
+  }
+
+  static iocshArg const GpioShmArg0 = { "name", iocshArgString };
+  static iocshArg const* const GpioShmArgs[] = { &GpioShmArg0 };
+  static iocshFuncDef const GpioShmFuncDef = { "GpioShm", 1, GpioShmArgs };
+
+  static void GpioShmCallFunc( iocshArgBuf const *args ) {
+    if( !args[0].sval || !*args[0].sval ) {
+      std::cerr << "Usage: GpioShm( <name> )" << std::endl;
+      return;
+    }
+    if( !intHandlers.empty() ) {
+      std::cerr << "GpioShm: Has to be enabled before iocInit" << std::endl;
+      return;
+    }
+    shmName = args[0].sval;
+  }
+
+  static iocshArg const GpioRecorderArg0 = { "file", iocshArgString };
+  static iocshArg const GpioRecorderArg1 = { "events", iocshArgInt };
+  static iocshArg const* const GpioRecorderArgs[] = { &GpioRecorderArg0, &GpioRecorderArg1 };
+  static iocshFuncDef const GpioRecorderFuncDef = { "GpioRecorder", 2, GpioRecorderArgs };
+
+  static void GpioRecorderCallFunc( iocshArgBuf const *args ) {
+    if( !args[0].sval || 0 >= args[1].ival ) {
+      std::cerr << "Usage: GpioRecorder( <file>, <number of events> )" << std::endl;
+      return;
+    }
+    if( recorder || !intHandlers.empty() ) {
+      std::cerr << "GpioRecorder: Has to be enabled once before iocInit" << std::endl;
+      return;
+    }
+    recorder = new GpioRecorder();
+    if( !recorder->open( args[0].sval, args[1].ival ) ) {
+      delete recorder;
+      recorder = nullptr;
+    }
+  }
+
+  static iocshArg const GpioRecorderFreezeArg0 = { "freeze", iocshArgInt };
+  static iocshArg const* const GpioRecorderFreezeArgs[] = { &GpioRecorderFreezeArg0 };
+  static iocshFuncDef const GpioRecorderFreezeFuncDef = { "GpioRecorderFreeze", 1, GpioRecorderFreezeArgs };
+
+  static void GpioRecorderFreezeCallFunc( iocshArgBuf const *args ) {
+    if( recorder ) recorder->freeze( 0 != args[0].ival );
+  }
+
+  static iocshArg const GpioRecorderExportArg0 = { "file", iocshArgString };
+  static iocshArg const GpioRecorderExportArg1 = { "window", iocshArgDouble };
+  static iocshArg const* const GpioRecorderExportArgs[] = { &GpioRecorderExportArg0, &GpioRecorderExportArg1 };
+  static iocshFuncDef const GpioRecorderExportFuncDef = { "GpioRecorderExport", 2, GpioRecorderExportArgs };
+
+  static void GpioRecorderExportCallFunc( iocshArgBuf const *args ) {
+    if( !recorder || !args[0].sval ) {
+      std::cerr << "Usage: GpioRecorderExport( <file>, <window in seconds> )" << std::endl;
+      return;
+    }
+    recorder->exportVcd( args[0].sval, args[1].dval );
+  }
+
+  static iocshArg const GpioIntGroupArg0 = { "name", iocshArgString };
+  static iocshArg const GpioIntGroupArg1 = { "priority", iocshArgInt };
+  static iocshArg const GpioIntGroupArg2 = { "cpus", iocshArgString };
+  static iocshArg const* const GpioIntGroupArgs[] = { &GpioIntGroupArg0, &GpioIntGroupArg1, &GpioIntGroupArg2 };
+  static iocshFuncDef const GpioIntGroupFuncDef = { "GpioIntGroup", 3, GpioIntGroupArgs };
+
+  static void GpioIntGroupCallFunc( iocshArgBuf const *args ) {
+    if( !args[0].sval || !*args[0].sval || args[1].ival < 1 || args[1].ival > 99 ) {
+      std::cerr << "Usage: GpioIntGroup( <name>, <priority 1-99>, [cpus, e.g. \"2,3\"] )" << std::endl;
+      return;
+    }
+    if( !intHandlers.empty() ) {
+      std::cerr << "GpioIntGroup: Groups have to be defined before iocInit" << std::endl;
+      return;
+    }
+    if( 255 <= intGroups.size() + 1 ) {
+      std::cerr << "GpioIntGroup: Too many groups" << std::endl;
+      return;
+    }
+    for( auto const& g : intGroups ) {
+      if( iequals( g.name, args[0].sval ) ) {
+        std::cerr << "GpioIntGroup: Group " << args[0].sval << " already defined" << std::endl;
+        return;
+      }
+    }
+    GpioIntGroup g = { args[0].sval, (unsigned int)args[1].ival,
+                       args[2].sval ? args[2].sval : "" };
+    intGroups.push_back( g );
+  }
+
   void devGpioRegister( void ) {
     static bool firstTime = true;
     if ( firstTime ) {
       iocshRegister( &GpioChipFuncDef, GpioChipCallFunc );
+      iocshRegister( &GpioReportFuncDef, GpioReportCallFunc );
+      iocshRegister( &GpioIntGroupFuncDef, GpioIntGroupCallFunc );
+      iocshRegister( &GpioReflexFuncDef, GpioReflexCallFunc );
+      iocshRegister( &GpioReflexResetFuncDef, GpioReflexResetCallFunc );
+      iocshRegister( &GpioCoincidenceFuncDef, GpioCoincidenceCallFunc );
+      iocshRegister( &GpioShmFuncDef, GpioShmCallFunc );
+      iocshRegister( &GpioRecorderFuncDef, GpioRecorderCallFunc );
+      iocshRegister( &GpioRecorderFreezeFuncDef, GpioRecorderFreezeCallFunc );
+      iocshRegister( &GpioRecorderExportFuncDef, GpioRecorderExportCallFunc );
       firstTime = false;
     }
   }
 
   epicsExportRegistrar( devGpioRegister );
+  epicsExportAddress( int, devGpioPoolSize );
+  epicsExportAddress( int, devGpioQueueSize );
+  epicsExportAddress( int, devGpioStormRate );
+  epicsExportAddress( double, devGpioStormQuiet );
+  epicsExportAddress( int, devGpioSamplerPriority );
 }
 
@@ -28,13 +28,16 @@
 /*_____ I N C L U D E S ______________________________________________________*/
 
 /* ANSI C includes  */
+#include <linux/gpio.h>
 
 /* EPICS includes */
 #include <callback.h>
 #include <dbCommon.h>
 #include <dbScan.h>
 #include <devSup.h>
+#include <epicsMutex.h>
 #include <epicsTime.h>
+#include <epicsTypes.h>
 #include <shareLib.h>
 
 /* local includes */
@@ -46,6 +49,40 @@
 #define DO_NOT_CONVERT        2
 #define ERROR                 -1
 
+/* Size of a cache line, used to align the per-line dispatch state */
+#define DEVGPIO_CACHELINE     64
+
+/* Modes of operation of a line request */
+#define DEVGPIO_MODE_LEVELS   0   /**< Track line levels only */
+#define DEVGPIO_MODE_QUAD     1   /**< Quadrature encoder (A, B, optional index) */
+#define DEVGPIO_MODE_SHIFT    2   /**< Shift register (data, clock, latch) */
+#define DEVGPIO_MODE_SAMPLER  3   /**< Periodic sampling into waveforms */
+#define DEVGPIO_MODE_PULSE    4   /**< Pulse widths and duty cycle */
+
+/* Quantities of pulse measurements */
+#define DEVGPIO_PULSE_HIGH    0   /**< Width of high pulses in us */
+#define DEVGPIO_PULSE_LOW     1   /**< Width of low pulses in us */
+#define DEVGPIO_PULSE_PERIOD  2   /**< Period in us */
+#define DEVGPIO_PULSE_DUTY    3   /**< Duty cycle in percent */
+#define DEVGPIO_PULSE_NQ      4
+
+/* Statistics of pulse measurements within a window */
+#define DEVGPIO_STAT_MEAN     0
+#define DEVGPIO_STAT_MIN      1
+#define DEVGPIO_STAT_MAX      2
+
+struct devGpio_info;
+
+/**
+ * @brief Fast path of a device support
+ *
+ * Called by the interrupt handler instead of processing the record, with
+ * the time (CLOCK_MONOTONIC) of the last level change: the kernel timestamp
+ * of the last edge event, or the time of the poll while edge detection is
+ * disabled by an interrupt storm.
+ */
+typedef void (*devGpio_post_t)( struct devGpio_info *pinfo, epicsUInt64 ts );
+
 /**
  * @brief Record configuration
  *
@@ -55,18 +92,121 @@
 typedef struct {
   struct link const* ioLink;
   epicsUInt64 flags;
+  epicsUInt8 mode;     /**< Mode of operation (DEVGPIO_MODE_*) */
+  epicsUInt8 shared;   /**< Line request is shared by default */
+  epicsUInt8 arm;      /**< Watch edge events independent of the record's SCAN */
+  double rate;         /**< Maximum publish rate or sampling rate in Hz */
+  epicsUInt64 inmask;  /**< Lines requested as input in an output request */
+  epicsUInt32 nbits;   /**< Shift register: length of the chain */
+  epicsUInt8 lsb;      /**< Shift register: shift LSB first */
+  epicsUInt8 outonly;  /**< Shift register: output record, IN is not allowed */
+  epicsUInt8 quantity; /**< Pulse: measured quantity (DEVGPIO_PULSE_*) */
+  epicsUInt8 stat;     /**< Pulse: statistic (DEVGPIO_STAT_*) */
+  devGpio_post_t post; /**< Fast path enabled by the FAST option, NULL if not supported */
 } devGpio_rec_t;
 
+/**
+ * @brief Configuration and statistics of a line request
+ *
+ * Data which is not needed to dispatch an edge. Kept in an array parallel
+ * to the pool of private device data.
+ */
+typedef struct devGpio_cold {
+  epicsUInt64 flags;                /**< Flags the lines were requested with */
+  epicsUInt64 inmask;               /**< Lines switched to input by an attribute */
+  epicsUInt32 offsets[GPIO_V2_LINES_MAX]; /**< Offsets of the requested lines */
+  epicsUInt32 nrecs;                /**< Number of records using the line request */
+  epicsUInt32 narmed;               /**< Number of users of the interrupt handler */
+  epicsUInt64 nstorms;              /**< Number of interrupt storms */
+  epicsUInt8 scheduled;             /**< Outputs are set by the scheduler */
+  epicsUInt64 delay_ns;             /**< Scheduled outputs: delay of the command */
+  struct devGpio_info *trigger;     /**< Scheduled outputs: delay relative to last edge of this request */
+  epicsUInt8 reflex;                /**< Output driven by a reflex rule, writes of records are refused */
+} devGpio_cold_t;
+
 /**
  * @brief Private Device Data
  *
- * Private data needed by device support routines
+ * Private data needed by device support routines. One entry per line
+ * request, taken from a preallocated, cache-line aligned pool. The index
+ * of the entry within the pool is used as epoll data by the interrupt
+ * handler, so dispatching an edge does neither allocate nor chase pointers.
+ * The entries only hold what the interrupt handler touches, configuration
+ * and statistics are in the cold part, data of a mode in ext.
+ *
+ * Line requests with the SHARED option are used by all records configured
+ * for the same lines and flags. Edges on those lines trigger the IOSCANPVT
+ * instead of processing a single record.
+ */
+typedef struct devGpio_info {
+  int fd;                           /**< File descriptor for GPIO handling */
+  epicsUInt32 index;                /**< Index of this entry within the pool */
+  epicsUInt8 shared;                /**< Edges trigger scanIoRequest for all records */
+  epicsUInt8 mode;                  /**< Mode of operation (DEVGPIO_MODE_*) */
+  epicsUInt8 pending;               /**< Publishing delayed by rate limit */
+  epicsUInt8 group;                 /**< Group of the interrupt handler */
+  epicsUInt8 throttled;             /**< Edge detection disabled by an interrupt storm */
+  epicsUInt32 nintr;                /**< Number of records in the I/O Intr scan list */
+  epicsUInt32 nlines;               /**< Number of requested lines */
+  epicsUInt64 levels;               /**< Line levels as given by the edge events */
+  epicsUInt64 period_ns;            /**< Minimum time between two publishes */
+  epicsUInt64 published_ns;         /**< Time of last publish */
+  void *reflex;                     /**< Reflex rules depending on these lines */
+  void *coinc;                      /**< Coincidence rules depending on these lines */
+  dbCommon *prec;                   /**< Record owning the line request */
+  CALLBACK callback;                /**< EPICS callback structure */
+  IOSCANPVT ioscanpvt;              /**< EPICS Structure needed for I/O Intrupt handling*/
+  struct gpio_v2_line_event event;  /**< Last edge event read from the lines */
+  epicsUInt64 nevents;              /**< Number of edge events read */
+  epicsUInt64 trigger_ns;           /**< Timestamp of the last edge, read by scheduled outputs */
+  epicsUInt64 change_ns;            /**< Time of the last level change: edge timestamp, or time of the poll */
+  epicsUInt64 nlost;                /**< Number of edge events lost (seqno gaps) */
+  epicsUInt64 storm_ns;             /**< Start of rate window, while throttled: last level change */
+  epicsUInt64 stormEvents;          /**< Edge events within the rate window */
+  devGpio_post_t post;              /**< Fast path: posts the state instead of processing the record */
+  void *ext;                        /**< Data of the mode or device support */
+  devGpio_cold_t *cold;             /**< Configuration and statistics */
+} __attribute__(( aligned( DEVGPIO_CACHELINE ) )) devGpio_info_t;
+
+/**
+ * @brief Quadrature encoder of a line request
+ */
+typedef struct {
+  epicsInt64 position;              /**< Current position */
+  epicsInt64 pubPosition;           /**< Position at last publish */
+  double pubVelocity;               /**< Velocity at last publish */
+  epicsUInt64 nerrors;              /**< Missed edges (line seqno gaps, redundant edges) */
+  epicsUInt32 seqno[3];             /**< Line seqno of the last edge of A, B and index */
+  epicsUInt8 stale;                 /**< Edges missed during an interrupt storm, cleared by the index */
+} devGpio_quad_t;
+
+/**
+ * @brief Pulse measurement of a line request
+ *
+ * Edges are paired by the interrupt handler into the current window. At
+ * the end of each window its statistics are copied into the published
+ * ones, which are read by the records.
  */
 typedef struct {
-  int fd;              /**< File descriptor for GPIO handling */
-  CALLBACK *pcallback; /**< Address of EPICS callback structure */
-  IOSCANPVT ioscanpvt; /**< EPICS Structure needed for I/O Intrupt handling*/
-} devGpio_info_t;
+  epicsUInt64 rise_ns;                    /**< Timestamp of last rising edge, 0 if unknown */
+  epicsUInt64 fall_ns;                    /**< Timestamp of last falling edge, 0 if unknown */
+  epicsUInt32 seqno;                      /**< Line seqno of the last edge */
+  epicsUInt32 n[DEVGPIO_PULSE_NQ];        /**< Current window: number of measurements */
+  double min[DEVGPIO_PULSE_NQ];           /**< Current window: minima */
+  double max[DEVGPIO_PULSE_NQ];           /**< Current window: maxima */
+  double sum[DEVGPIO_PULSE_NQ];           /**< Current window: sums */
+  epicsMutexId lock;                      /**< Protects the published window */
+  epicsUInt32 pubN[DEVGPIO_PULSE_NQ];     /**< Published window: number of measurements */
+  double pub[DEVGPIO_PULSE_NQ][3];        /**< Published window: statistics (DEVGPIO_STAT_*) */
+  epicsUInt8 pubLevel;                    /**< Level of the line at publishing */
+} devGpio_pulse_t;
+
+/**
+ * @brief Mask covering the first nobt lines of a line request
+ */
+static inline epicsUInt64 devGpioMask( epicsUInt32 nobt ) {
+  return ( 64u <= nobt ) ? ~0ull : ( ( 1ull << nobt ) - 1ull );
+}
 
 #ifdef __cplusplus
 extern "C" {
@@ -74,8 +214,27 @@ extern "C" {
 
 epicsShareExtern long devGpioInit( int after );
 epicsShareExtern epicsUInt16 devGpioInitRecord( dbCommon *prec, devGpio_rec_t* pconf );
+epicsShareExtern void devGpioReleaseRecord( dbCommon *prec, devGpio_rec_t const* pconf );
+epicsShareExtern int devGpioSamplerPriority;
 epicsShareExtern long devGpioGetIoIntInfo( int cmd, dbCommon *prec, IOSCANPVT *ppvt );
+epicsShareExtern long devGpioIoIntInfo( int cmd, devGpio_info_t *pinfo, IOSCANPVT *ppvt );
 epicsShareExtern void devGpioCallback( CALLBACK *pcallback );
+epicsShareExtern void devGpioReadback_bo( CALLBACK *pcallback );
+epicsShareExtern void devGpioSamplerReport( devGpio_info_t const* pinfo );
+epicsShareExtern void devGpioStormAlarm( dbCommon *prec, devGpio_info_t const* pinfo );
+epicsShareExtern void devGpioShmLevels( devGpio_info_t const* pinfo, epicsUInt64 bits, epicsUInt64 mask );
+epicsShareExtern long devGpioSchedulerInit( void );
+epicsShareExtern devGpio_info_t* devGpioLookup( char const* name );
+epicsShareExtern devGpio_info_t* devGpioLookupTrigger( char const* name );
+epicsShareExtern epicsUInt64 devGpioScheduleBase( devGpio_info_t const* trigger );
+epicsShareExtern long devGpioSchedule( devGpio_info_t* pinfo, epicsUInt64 deadline_ns,
+                                       epicsUInt64 bits, epicsUInt64 mask );
+epicsShareExtern long devGpioScheduleWrite( devGpio_info_t* pinfo, epicsUInt64 bits, epicsUInt64 mask );
+epicsShareExtern void* devGpioCoincFind( char const* name );
+epicsShareExtern IOSCANPVT devGpioCoincScan( void* prule );
+epicsShareExtern void devGpioCoincStormAlarm( dbCommon *prec, void* prule );
+epicsShareExtern void devGpioCoincRead( void* prule, epicsUInt64* ncoinc, epicsUInt64* nviolations,
+                                        epicsInt64* delta_ns, epicsUInt8* inorder );
 
 #ifdef __cplusplus
 } //extern "C"
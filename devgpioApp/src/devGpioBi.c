@@ -40,6 +40,7 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 #include <linux/gpio.h>
 #include <sys/ioctl.h>
 
@@ -47,8 +48,10 @@
 #include <biRecord.h>
 #include <alarm.h>
 #include <dbAccess.h>
+#include <dbEvent.h>
 #include <errlog.h>
 #include <epicsExport.h>
+#include <epicsTime.h>
 #include <epicsTypes.h>
 #include <iocLog.h>
 #include <iocsh.h>
@@ -60,6 +63,7 @@
 /*_____ D E F I N I T I O N S ________________________________________________*/
 static long devGpioInitRecord_bi( struct dbCommon *p );
 static long devGpioRead_bi( struct biRecord *prec );
+static void devGpioPost_bi( devGpio_info_t *pinfo, epicsUInt64 ts );
 
 /*_____ G L O B A L S ________________________________________________________*/
 
@@ -91,10 +95,12 @@ long devGpioInitRecord_bi( struct dbCommon *p ){
   prec->pact = (epicsUInt8)true; /* disable record */
 
   devGpio_rec_t conf = { &prec->inp, GPIO_V2_LINE_FLAG_INPUT };
+  conf.post = devGpioPost_bi;
   epicsUInt16 nobt = devGpioInitRecord( p, &conf );
   if( 1 != nobt ) {
     fprintf( stderr, "\033[31;1m%s: Invalid number of gpio lines: %u\033[0m\n",
              prec->name, nobt );
+    devGpioReleaseRecord( p, &conf );
     return ERROR;
   }
 
@@ -123,6 +129,83 @@ long devGpioRead_bi( struct biRecord *prec ) {
     return ERROR;
   }
   prec->rval = values.bits & 1;
+  devGpioStormAlarm( (dbCommon *)prec, pinfo );
+  devGpioShmLevels( pinfo, values.bits, 1 );
   return OK;
 }
 
+
+/**-----------------------------------------------------------------------------
+ * @brief   Fast path of bi records with the FAST option
+ *
+ * Called by the interrupt handler instead of processing the record. The
+ * level given by the edge events is converted like the record would do,
+ * state and change of state alarms are evaluated and monitors are posted.
+ * The line is not read again and the forward link is not processed.
+ * With TSE = -2 the record gets the time of the edge, or of the poll which
+ * found the change during an interrupt storm. Disabled records (DISA equal
+ * to DISV) only get the DISABLE alarm.
+ *
+ * @param   [in]  pinfo  Address of the line's private data structure
+ * @param   [in]  ts     Time of the last level change (CLOCK_MONOTONIC)
+ *----------------------------------------------------------------------------*/
+static void devGpioPost_bi( devGpio_info_t *pinfo, epicsUInt64 ts ) {
+  struct biRecord *prec = (struct biRecord *)pinfo->prec;
+  if( !interruptAccept ) return;
+
+  struct timespec now_mono, now_real;
+  if( epicsTimeEventDeviceTime == prec->tse ) {
+    clock_gettime( CLOCK_MONOTONIC, &now_mono );
+    clock_gettime( CLOCK_REALTIME, &now_real );
+  }
+
+  dbScanLock( (dbCommon *)prec );
+  /* disabled records are not updated, like dbProcess() does */
+  dbGetLink( &prec->sdis, DBR_SHORT, &prec->disa, 0, 0 );
+  if( prec->disa == prec->disv ) {
+    if( DISABLE_ALARM != prec->stat ) {
+      prec->sevr = prec->diss;
+      prec->stat = DISABLE_ALARM;
+      prec->nsev = 0;
+      prec->nsta = 0;
+      db_post_events( prec, &prec->stat, DBE_VALUE );
+      db_post_events( prec, &prec->sevr, DBE_VALUE );
+    }
+    dbScanUnlock( (dbCommon *)prec );
+    return;
+  }
+
+  prec->rval = pinfo->levels & 1;
+  if( prec->mask ) prec->rval &= prec->mask;
+  prec->val = ( 0 == prec->rval ) ? 0 : 1;
+  prec->udf = 0;
+
+  if( epicsTimeEventDeviceTime == prec->tse ) {
+    epicsUInt64 mono = (epicsUInt64)now_mono.tv_sec * 1000000000ull + now_mono.tv_nsec;
+    epicsUInt64 real = (epicsUInt64)now_real.tv_sec * 1000000000ull + now_real.tv_nsec;
+    epicsUInt64 event = real - ( ts < mono ? mono - ts : 0 );
+    struct timespec tevent = { (time_t)( event / 1000000000ull ), (long)( event % 1000000000ull ) };
+    epicsTimeFromTimespec( &prec->time, &tevent );
+  } else {
+    recGblGetTimeStamp( prec );
+  }
+
+  devGpioStormAlarm( (dbCommon *)prec, pinfo );
+  recGblSetSevr( prec, STATE_ALARM, prec->val ? prec->osv : prec->zsv );
+  if( prec->val != prec->lalm ) {
+    recGblSetSevr( prec, COS_ALARM, prec->cosv );
+    prec->lalm = prec->val;
+  }
+
+  unsigned short monitor_mask = recGblResetAlarms( prec );
+  if( prec->mlst != prec->val ) {
+    monitor_mask |= DBE_VALUE | DBE_LOG;
+    prec->mlst = prec->val;
+  }
+  if( monitor_mask ) db_post_events( prec, &prec->val, monitor_mask );
+  if( prec->oraw != prec->rval ) {
+    db_post_events( prec, &prec->rval, monitor_mask | DBE_VALUE | DBE_LOG );
+    prec->oraw = prec->rval;
+  }
+  dbScanUnlock( (dbCommon *)prec );
+}
@@ -46,7 +46,9 @@
 /* EPICS includes */
 #include <boRecord.h>
 #include <alarm.h>
+#include <callback.h>
 #include <dbAccess.h>
+#include <dbEvent.h>
 #include <errlog.h>
 #include <epicsExport.h>
 #include <epicsTypes.h>
@@ -94,6 +96,7 @@ static long devGpioInitRecord_bo( struct dbCommon *p ){
   if( 1 != nobt ) {
     fprintf( stderr, "\033[31;1m%s: Invalid number of gpio lines: %u\033[0m\n",
              prec->name, nobt );
+    devGpioReleaseRecord( p, &conf );
     return ERROR;
   }
 
@@ -106,6 +109,9 @@ static long devGpioInitRecord_bo( struct dbCommon *p ){
 /**-----------------------------------------------------------------------------
  * @brief   Write routine of bo records
  *
+ * Writes to an output driven by a reflex rule are refused, the record gets
+ * the level of the line back.
+ *
  * @param   [in]  prec   Address of the record calling this function
  *
  * @return  In case of error return -1, otherwise return 0
@@ -114,6 +120,20 @@ long devGpioWrite_bo( boRecord *prec ) {
   devGpio_info_t *pinfo = (devGpio_info_t *)prec->dpvt;
 
   struct gpio_v2_line_values values = { prec->rval, 1 };
+  if( pinfo->cold->reflex ) {
+    values.bits = 0;
+    if( 0 == ioctl( pinfo->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values ) ) {
+      prec->rval = values.bits & 1;
+      prec->val = prec->rval ? 1 : 0;
+    }
+    recGblSetSevr( prec, WRITE_ALARM, INVALID_ALARM );
+    return ERROR;
+  }
+  if( pinfo->cold->scheduled ) {
+    if( OK == devGpioScheduleWrite( pinfo, values.bits, values.mask ) ) return OK;
+    recGblSetSevr( prec, WRITE_ALARM, INVALID_ALARM );
+    return ERROR;
+  }
   int ret = ioctl( pinfo->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values );
   if( -1 == ret ) {
     fprintf( stderr, "\033[31;1m%s: Could not set gpio line: %s\033[0m\n",
@@ -121,6 +141,45 @@ long devGpioWrite_bo( boRecord *prec ) {
     recGblSetSevr( prec, WRITE_ALARM, INVALID_ALARM );
     return ERROR;
   }
+  devGpioShmLevels( pinfo, values.bits, 1 );
   return OK;
 }
 
+
+/**-----------------------------------------------------------------------------
+ * @brief   Update bo record with the current level of its gpio line
+ *
+ * Callback used after the output line has been set by a reflex rule. Updates
+ * VAL and RVAL and posts monitors without writing the line again.
+ *
+ * @param   [in]  pcallback   Address of EPICS CALLBACK structure
+ *----------------------------------------------------------------------------*/
+void devGpioReadback_bo( CALLBACK *pcallback ) {
+  void *puser;
+  callbackGetUser( puser, pcallback );
+  struct boRecord *prec = (struct boRecord *)puser;
+  devGpio_info_t *pinfo = (devGpio_info_t *)prec->dpvt;
+
+  struct gpio_v2_line_values values = { 0, 1 };
+  dbScanLock( (dbCommon *)prec );
+  int ret = ioctl( pinfo->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values );
+  if( -1 == ret ) {
+    fprintf( stderr, "\033[31;1m%s: Could not read gpio line: %s\033[0m\n",
+             prec->name, strerror( errno ) );
+    dbScanUnlock( (dbCommon *)prec );
+    return;
+  }
+  prec->rval = values.bits & 1;
+  prec->val = prec->rval ? 1 : 0;
+  prec->udf = 0;
+  recGblGetTimeStamp( prec );
+  if( prec->mlst != prec->val ) {
+    db_post_events( prec, &prec->val, DBE_VALUE | DBE_LOG );
+    prec->mlst = prec->val;
+  }
+  if( prec->oraw != prec->rval ) {
+    db_post_events( prec, &prec->rval, DBE_VALUE | DBE_LOG );
+    prec->oraw = prec->rval;
+  }
+  dbScanUnlock( (dbCommon *)prec );
+}
@@ -0,0 +1,277 @@
+/*******************************************************************************
+ * Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+ *                    - Helmholtz-Institut Mainz
+ *
+ * This file is part of devGpio
+ *
+ * devGpio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * devGpio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * version 1.0.0; Aug 13, 2015
+ *
+*******************************************************************************/
+
+/**
+ * @file devGpioBus.c
+ * @brief Device Support implementation for wide buses
+ *
+ * longin/longout (up to 32 lines) and int64in/int64out (up to 64 lines)
+ * records reading or writing all lines of a line request with a single ioctl.
+ */
+
+/*_____ I N C L U D E S ______________________________________________________*/
+
+/* ANSI C includes  */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <linux/gpio.h>
+#include <sys/ioctl.h>
+
+/* EPICS includes */
+#include <int64inRecord.h>
+#include <int64outRecord.h>
+#include <longinRecord.h>
+#include <longoutRecord.h>
+#include <alarm.h>
+#include <dbAccess.h>
+#include <epicsExport.h>
+#include <epicsTypes.h>
+#include <recGbl.h>
+
+/* local includes */
+#include "devGpio.h"
+
+/*_____ D E F I N I T I O N S ________________________________________________*/
+static long devGpioInitRecord_bus( struct dbCommon *p, struct link const* plink,
+                                   epicsUInt64 flags, epicsUInt16 maxbits );
+static long devGpioInitRecord_longin( struct dbCommon *p );
+static long devGpioInitRecord_longout( struct dbCommon *p );
+static long devGpioInitRecord_int64in( struct dbCommon *p );
+static long devGpioInitRecord_int64out( struct dbCommon *p );
+static long devGpioReadBus( struct dbCommon *prec, epicsUInt64 *pbits );
+static long devGpioWriteBus( struct dbCommon *prec, epicsUInt64 bits );
+static long devGpioRead_longin( struct longinRecord *prec );
+static long devGpioWrite_longout( struct longoutRecord *prec );
+static long devGpioRead_int64in( struct int64inRecord *prec );
+static long devGpioWrite_int64out( struct int64outRecord *prec );
+
+/*_____ G L O B A L S ________________________________________________________*/
+
+longindset devGpioLongin = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_longin,
+    devGpioGetIoIntInfo
+  },
+  devGpioRead_longin
+};
+epicsExportAddress( dset, devGpioLongin );
+
+longoutdset devGpioLongout = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_longout,
+    NULL
+  },
+  devGpioWrite_longout
+};
+epicsExportAddress( dset, devGpioLongout );
+
+int64indset devGpioInt64in = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_int64in,
+    devGpioGetIoIntInfo
+  },
+  devGpioRead_int64in
+};
+epicsExportAddress( dset, devGpioInt64in );
+
+int64outdset devGpioInt64out = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_int64out,
+    NULL
+  },
+  devGpioWrite_int64out
+};
+epicsExportAddress( dset, devGpioInt64out );
+
+/*_____ L O C A L S __________________________________________________________*/
+
+/*_____ F U N C T I O N S ____________________________________________________*/
+
+/**-----------------------------------------------------------------------------
+ * @brief   Common initialization of bus records
+ *
+ * @param   [in]  p        Address of the record calling this function
+ * @param   [in]  plink    Address of the record's INP/OUT field
+ * @param   [in]  flags    Direction of the lines
+ * @param   [in]  maxbits  Maximum number of lines supported by the record
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioInitRecord_bus( struct dbCommon *p, struct link const* plink,
+                                   epicsUInt64 flags, epicsUInt16 maxbits ){
+  p->pact = (epicsUInt8)true; /* disable record */
+
+  devGpio_rec_t conf = { plink, flags };
+  epicsUInt16 nobt = devGpioInitRecord( p, &conf );
+  if( 1u > nobt || maxbits < nobt ) {
+    fprintf( stderr, "\033[31;1m%s: Invalid number of gpio lines: %u\033[0m\n",
+             p->name, nobt );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
+
+  p->udf = 0;
+  p->pact = (epicsUInt8)false; /* enable record */
+
+  return OK;
+}
+
+static long devGpioInitRecord_longin( struct dbCommon *p ){
+  return devGpioInitRecord_bus( p, &((struct longinRecord *)p)->inp, GPIO_V2_LINE_FLAG_INPUT, 32 );
+}
+
+static long devGpioInitRecord_longout( struct dbCommon *p ){
+  return devGpioInitRecord_bus( p, &((struct longoutRecord *)p)->out, GPIO_V2_LINE_FLAG_OUTPUT, 32 );
+}
+
+static long devGpioInitRecord_int64in( struct dbCommon *p ){
+  return devGpioInitRecord_bus( p, &((struct int64inRecord *)p)->inp, GPIO_V2_LINE_FLAG_INPUT, 64 );
+}
+
+static long devGpioInitRecord_int64out( struct dbCommon *p ){
+  return devGpioInitRecord_bus( p, &((struct int64outRecord *)p)->out, GPIO_V2_LINE_FLAG_OUTPUT, 64 );
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read all lines of a bus
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ * @param   [out] pbits  Levels of the lines
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioReadBus( struct dbCommon *prec, epicsUInt64 *pbits ) {
+  devGpio_info_t *pinfo = (devGpio_info_t *)prec->dpvt;
+
+  struct gpio_v2_line_values values = { 0, devGpioMask( pinfo->nlines ) };
+  int ret = ioctl( pinfo->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values );
+  if( -1 == ret ) {
+    fprintf( stderr, "\033[31;1m%s: Could not read gpio lines: %s\033[0m\n",
+             prec->name, strerror( errno ) );
+    recGblSetSevr( prec, READ_ALARM, INVALID_ALARM );
+    return ERROR;
+  }
+  *pbits = values.bits & values.mask;
+  devGpioStormAlarm( prec, pinfo );
+  devGpioShmLevels( pinfo, values.bits, values.mask );
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Write all lines of a bus
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ * @param   [in]  bits   Levels of the lines
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioWriteBus( struct dbCommon *prec, epicsUInt64 bits ) {
+  devGpio_info_t *pinfo = (devGpio_info_t *)prec->dpvt;
+
+  struct gpio_v2_line_values values = { 0, devGpioMask( pinfo->nlines ) };
+  values.bits = bits & values.mask;
+  if( pinfo->cold->reflex ) {
+    /* line is driven by a reflex rule */
+    recGblSetSevr( prec, WRITE_ALARM, INVALID_ALARM );
+    return ERROR;
+  }
+  if( pinfo->cold->scheduled ) {
+    if( OK == devGpioScheduleWrite( pinfo, values.bits, values.mask ) ) return OK;
+    recGblSetSevr( prec, WRITE_ALARM, INVALID_ALARM );
+    return ERROR;
+  }
+  int ret = ioctl( pinfo->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values );
+  if( -1 == ret ) {
+    fprintf( stderr, "\033[31;1m%s: Could not set gpio lines: %s\033[0m\n",
+             prec->name, strerror( errno ) );
+    recGblSetSevr( prec, WRITE_ALARM, INVALID_ALARM );
+    return ERROR;
+  }
+  devGpioShmLevels( pinfo, values.bits, values.mask );
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of longin records
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_longin( struct longinRecord *prec ) {
+  epicsUInt64 bits;
+  long status = devGpioReadBus( (struct dbCommon *)prec, &bits );
+  if( OK == status ) prec->val = (epicsInt32)(epicsUInt32)bits;
+  return status;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Write routine of longout records
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioWrite_longout( struct longoutRecord *prec ) {
+  return devGpioWriteBus( (struct dbCommon *)prec, (epicsUInt32)prec->val );
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of int64in records
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_int64in( struct int64inRecord *prec ) {
+  epicsUInt64 bits;
+  long status = devGpioReadBus( (struct dbCommon *)prec, &bits );
+  if( OK == status ) prec->val = (epicsInt64)bits;
+  return status;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Write routine of int64out records
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioWrite_int64out( struct int64outRecord *prec ) {
+  return devGpioWriteBus( (struct dbCommon *)prec, (epicsUInt64)prec->val );
+}
@@ -0,0 +1,290 @@
+/*******************************************************************************
+ * Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+ *                    - Helmholtz-Institut Mainz
+ *
+ * This file is part of devGpio
+ *
+ * devGpio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * devGpio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * version 1.0.0; Aug 13, 2015
+ *
+*******************************************************************************/
+
+/**
+ * @file devGpioCoinc.c
+ * @brief Device Support implementation for coincidence detection
+ *
+ * Records providing the results of a coincidence rule defined with the
+ * iocsh command GpioCoincidence. The records are processed with
+ * SCAN="I/O Intr" whenever the rule matched.
+ */
+
+/*_____ I N C L U D E S ______________________________________________________*/
+
+/* ANSI C includes  */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* EPICS includes */
+#include <aiRecord.h>
+#include <biRecord.h>
+#include <int64inRecord.h>
+#include <longinRecord.h>
+#include <alarm.h>
+#include <dbAccess.h>
+#include <epicsExport.h>
+#include <epicsTypes.h>
+#include <link.h>
+#include <recGbl.h>
+
+/* local includes */
+#include "devGpio.h"
+
+/*_____ D E F I N I T I O N S ________________________________________________*/
+
+/**
+ * @brief Private data of coincidence records
+ */
+typedef struct {
+  void *prule;              /**< Coincidence rule */
+  epicsUInt8 violations;    /**< Counter records: count order violations */
+} devGpio_coinc_t;
+
+static long devGpioInitRecord_coinc( struct dbCommon *p, struct link const* plink, bool counter );
+static long devGpioInitRecord_coincLongin( struct dbCommon *p );
+static long devGpioInitRecord_coincInt64in( struct dbCommon *p );
+static long devGpioInitRecord_coincBi( struct dbCommon *p );
+static long devGpioInitRecord_coincAi( struct dbCommon *p );
+static long devGpioGetIoIntInfo_coinc( int cmd, struct dbCommon *p, IOSCANPVT *ppvt );
+static long devGpioRead_coincLongin( struct longinRecord *prec );
+static long devGpioRead_coincInt64in( struct int64inRecord *prec );
+static long devGpioRead_coincBi( struct biRecord *prec );
+static long devGpioRead_coincAi( struct aiRecord *prec );
+
+/*_____ G L O B A L S ________________________________________________________*/
+
+longindset devGpioCoincLongin = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_coincLongin,
+    devGpioGetIoIntInfo_coinc
+  },
+  devGpioRead_coincLongin
+};
+epicsExportAddress( dset, devGpioCoincLongin );
+
+int64indset devGpioCoincInt64in = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_coincInt64in,
+    devGpioGetIoIntInfo_coinc
+  },
+  devGpioRead_coincInt64in
+};
+epicsExportAddress( dset, devGpioCoincInt64in );
+
+bidset devGpioCoincBi = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_coincBi,
+    devGpioGetIoIntInfo_coinc
+  },
+  devGpioRead_coincBi
+};
+epicsExportAddress( dset, devGpioCoincBi );
+
+aidset devGpioCoincAi = {
+  {
+    6,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_coincAi,
+    devGpioGetIoIntInfo_coinc
+  },
+  devGpioRead_coincAi,
+  NULL
+};
+epicsExportAddress( dset, devGpioCoincAi );
+
+/*_____ L O C A L S __________________________________________________________*/
+
+/*_____ F U N C T I O N S ____________________________________________________*/
+
+/**-----------------------------------------------------------------------------
+ * @brief   Common initialization of coincidence records
+ *
+ * The syntax of the INP field is "@<RULE> [VIOLATIONS]", where VIOLATIONS
+ * is only allowed for counter records.
+ *
+ * @param   [in]  p        Address of the record calling this function
+ * @param   [in]  plink    Address of the record's INP field
+ * @param   [in]  counter  Record is a counter
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioInitRecord_coinc( struct dbCommon *p, struct link const* plink, bool counter ){
+  p->pact = (epicsUInt8)true; /* disable record */
+
+  if( INST_IO != plink->type ) {
+    fprintf( stderr, "\033[31;1m%s: Invalid link type for INP field: %s\033[0m\n",
+             p->name, pamaplinkType[plink->type].strvalue );
+    return ERROR;
+  }
+
+  char name[64] = "";
+  char option[16] = "";
+  int n = sscanf( plink->value.instio.string, "%63s %15s", name, option );
+  bool violations = ( 2 == n && 0 == strcasecmp( option, "VIOLATIONS" ) );
+  if( 1 > n || ( 2 == n && !( counter && violations ) ) ) {
+    fprintf( stderr, "\033[31;1m%s: Invalid INP field: %s\033[0m\n",
+             p->name, plink->value.instio.string );
+    return ERROR;
+  }
+
+  void *prule = devGpioCoincFind( name );
+  if( !prule ) {
+    fprintf( stderr, "\033[31;1m%s: Unknown coincidence rule: %s\033[0m\n",
+             p->name, name );
+    return ERROR;
+  }
+
+  devGpio_coinc_t *pcoinc = calloc( 1, sizeof( devGpio_coinc_t ) );
+  if( !pcoinc ) {
+    fprintf( stderr, "\033[31;1m%s: Out of memory\033[0m\n", p->name );
+    return ERROR;
+  }
+  pcoinc->prule = prule;
+  pcoinc->violations = violations;
+  p->dpvt = pcoinc;
+
+  p->udf = 0;
+  p->pact = (epicsUInt8)false; /* enable record */
+
+  return OK;
+}
+
+static long devGpioInitRecord_coincLongin( struct dbCommon *p ){
+  return devGpioInitRecord_coinc( p, &((struct longinRecord *)p)->inp, true );
+}
+
+static long devGpioInitRecord_coincInt64in( struct dbCommon *p ){
+  return devGpioInitRecord_coinc( p, &((struct int64inRecord *)p)->inp, true );
+}
+
+static long devGpioInitRecord_coincBi( struct dbCommon *p ){
+  return devGpioInitRecord_coinc( p, &((struct biRecord *)p)->inp, false );
+}
+
+static long devGpioInitRecord_coincAi( struct dbCommon *p ){
+  return devGpioInitRecord_coinc( p, &((struct aiRecord *)p)->inp, false );
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Get I/O Intr scan list of the coincidence rule
+ *
+ * @param   [in]  cmd   0 if record is placed in, 1 if removed from the list
+ * @param   [in]  p     Address of the record calling this function
+ * @param   [out] ppvt  Address of the IOSCANPVT structure
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioGetIoIntInfo_coinc( int cmd, struct dbCommon *p, IOSCANPVT *ppvt ) {
+  (void)cmd;
+  devGpio_coinc_t *pcoinc = (devGpio_coinc_t *)p->dpvt;
+  if( !pcoinc ) return ERROR;
+  *ppvt = devGpioCoincScan( pcoinc->prule );
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of longin records (number of matches or violations)
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_coincLongin( struct longinRecord *prec ) {
+  devGpio_coinc_t *pcoinc = (devGpio_coinc_t *)prec->dpvt;
+  epicsUInt64 ncoinc, nviolations;
+  epicsInt64 delta_ns;
+  epicsUInt8 inorder;
+  devGpioCoincStormAlarm( (dbCommon *)prec, pcoinc->prule );
+  devGpioCoincRead( pcoinc->prule, &ncoinc, &nviolations, &delta_ns, &inorder );
+  prec->val = (epicsInt32)( pcoinc->violations ? nviolations : ncoinc );
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of int64in records (number of matches or violations)
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_coincInt64in( struct int64inRecord *prec ) {
+  devGpio_coinc_t *pcoinc = (devGpio_coinc_t *)prec->dpvt;
+  epicsUInt64 ncoinc, nviolations;
+  epicsInt64 delta_ns;
+  epicsUInt8 inorder;
+  devGpioCoincStormAlarm( (dbCommon *)prec, pcoinc->prule );
+  devGpioCoincRead( pcoinc->prule, &ncoinc, &nviolations, &delta_ns, &inorder );
+  prec->val = (epicsInt64)( pcoinc->violations ? nviolations : ncoinc );
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of bi records (1 if the last match was in order)
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 2 (do not convert)
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_coincBi( struct biRecord *prec ) {
+  devGpio_coinc_t *pcoinc = (devGpio_coinc_t *)prec->dpvt;
+  epicsUInt64 ncoinc, nviolations;
+  epicsInt64 delta_ns;
+  epicsUInt8 inorder;
+  devGpioCoincStormAlarm( (dbCommon *)prec, pcoinc->prule );
+  devGpioCoincRead( pcoinc->prule, &ncoinc, &nviolations, &delta_ns, &inorder );
+  prec->val = inorder;
+  return DO_NOT_CONVERT;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of ai records (time from first to second edge in us)
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 2 (do not convert)
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_coincAi( struct aiRecord *prec ) {
+  devGpio_coinc_t *pcoinc = (devGpio_coinc_t *)prec->dpvt;
+  epicsUInt64 ncoinc, nviolations;
+  epicsInt64 delta_ns;
+  epicsUInt8 inorder;
+  devGpioCoincStormAlarm( (dbCommon *)prec, pcoinc->prule );
+  devGpioCoincRead( pcoinc->prule, &ncoinc, &nviolations, &delta_ns, &inorder );
+  prec->val = (double)delta_ns * 1e-3;
+  prec->udf = 0;
+  return DO_NOT_CONVERT;
+}
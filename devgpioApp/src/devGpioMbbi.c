@@ -91,10 +91,15 @@ static long devGpioInitRecord_mbbi( struct dbCommon *p ){
 
   devGpio_rec_t conf = { &prec->inp, GPIO_V2_LINE_FLAG_INPUT };
   epicsUInt16 nobt = devGpioInitRecord( p, &conf );
-  if( 1u > nobt )  return ERROR;
+  if( 1u > nobt || 32u < nobt ) {
+    fprintf( stderr, "\033[31;1m%s: Invalid number of gpio lines: %u\033[0m\n",
+             prec->name, nobt );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
 
   prec->nobt = nobt;
-  prec->mask = (( 1u << nobt ) - 1u);
+  prec->mask = (epicsUInt32)devGpioMask( nobt );
   prec->shft = 0;
 
   prec->udf = 0;
@@ -122,6 +127,8 @@ long devGpioRead_mbbi( struct mbbiRecord *prec ) {
     return ERROR;
   }
   prec->rval = (epicsUInt32)values.bits & prec->mask;
+  devGpioStormAlarm( (dbCommon *)prec, pinfo );
+  devGpioShmLevels( pinfo, values.bits, prec->mask );
   return OK;
 }
 
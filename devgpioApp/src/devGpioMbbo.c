@@ -91,10 +91,15 @@ static long devGpioInitRecord_mbbo( struct dbCommon *p ){
 
   devGpio_rec_t conf = { &prec->out, GPIO_V2_LINE_FLAG_OUTPUT };
   epicsUInt16 nobt = devGpioInitRecord( p, &conf );
-  if( 1u > nobt )  return ERROR;
+  if( 1u > nobt || 32u < nobt ) {
+    fprintf( stderr, "\033[31;1m%s: Invalid number of gpio lines: %u\033[0m\n",
+             prec->name, nobt );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
 
   prec->nobt = nobt;
-  prec->mask = (( 1u << nobt ) - 1u);
+  prec->mask = (epicsUInt32)devGpioMask( nobt );
   prec->shft = 0;
 
   prec->udf = 0;
@@ -114,6 +119,16 @@ long devGpioWrite_mbbo( mbboRecord *prec ) {
   devGpio_info_t *pinfo = (devGpio_info_t *)prec->dpvt;
 
   struct gpio_v2_line_values values = { prec->rval, prec->mask };
+  if( pinfo->cold->reflex ) {
+    /* line is driven by a reflex rule */
+    recGblSetSevr( prec, WRITE_ALARM, INVALID_ALARM );
+    return ERROR;
+  }
+  if( pinfo->cold->scheduled ) {
+    if( OK == devGpioScheduleWrite( pinfo, values.bits, values.mask ) ) return OK;
+    recGblSetSevr( prec, WRITE_ALARM, INVALID_ALARM );
+    return ERROR;
+  }
   int ret = ioctl( pinfo->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values );
   if( -1 == ret ) {
     fprintf( stderr, "\033[31;1m%s: Could not set gpio lines: %s\033[0m\n",
@@ -121,6 +136,7 @@ long devGpioWrite_mbbo( mbboRecord *prec ) {
     recGblSetSevr( prec, WRITE_ALARM, INVALID_ALARM );
     return ERROR;
   }
+  devGpioShmLevels( pinfo, values.bits, values.mask );
   return OK;
 }
 
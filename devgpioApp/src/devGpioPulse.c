@@ -0,0 +1,236 @@
+/*******************************************************************************
+ * Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+ *                    - Helmholtz-Institut Mainz
+ *
+ * This file is part of devGpio
+ *
+ * devGpio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * devGpio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * version 1.0.0; Aug 13, 2015
+ *
+*******************************************************************************/
+
+/**
+ * @file devGpioPulse.c
+ * @brief Device Support implementation for pulse width and duty cycle
+ *
+ * Rising and falling edges of a single line are paired by the interrupt
+ * handler using their kernel timestamps. Widths and periods are given in
+ * us, the duty cycle in percent. Minimum, maximum and mean are taken over
+ * a window which starts with the first edge and lasts one publish period.
+ */
+
+/*_____ I N C L U D E S ______________________________________________________*/
+
+/* ANSI C includes  */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <linux/gpio.h>
+
+/* EPICS includes */
+#include <aiRecord.h>
+#include <longinRecord.h>
+#include <alarm.h>
+#include <dbAccess.h>
+#include <epicsExport.h>
+#include <epicsMutex.h>
+#include <epicsTypes.h>
+#include <recGbl.h>
+
+/* local includes */
+#include "devGpio.h"
+
+/*_____ D E F I N I T I O N S ________________________________________________*/
+
+/**
+ * @brief Private data of pulse records
+ */
+typedef struct {
+  devGpio_info_t *pinfo;        /**< Line request of the measured line */
+  epicsUInt8 quantity;          /**< Measured quantity (DEVGPIO_PULSE_*) */
+  epicsUInt8 stat;              /**< Statistic (DEVGPIO_STAT_*) */
+} devGpio_pulse_rec_t;
+
+static long devGpioInitRecord_pulse( struct dbCommon *p, struct link const* plink );
+static long devGpioInitRecord_pulseLongin( struct dbCommon *p );
+static long devGpioInitRecord_pulseAi( struct dbCommon *p );
+static long devGpioGetIoIntInfo_pulse( int cmd, struct dbCommon *p, IOSCANPVT *ppvt );
+static long devGpioRead_pulseLongin( struct longinRecord *prec );
+static long devGpioRead_pulseAi( struct aiRecord *prec );
+
+/* Default publish rate in Hz */
+#define PULSE_DEFAULT_RATE 10.
+
+/*_____ G L O B A L S ________________________________________________________*/
+
+longindset devGpioPulseLongin = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_pulseLongin,
+    devGpioGetIoIntInfo_pulse
+  },
+  devGpioRead_pulseLongin
+};
+epicsExportAddress( dset, devGpioPulseLongin );
+
+aidset devGpioPulseAi = {
+  {
+    6,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_pulseAi,
+    devGpioGetIoIntInfo_pulse
+  },
+  devGpioRead_pulseAi,
+  NULL
+};
+epicsExportAddress( dset, devGpioPulseAi );
+
+/*_____ L O C A L S __________________________________________________________*/
+
+/*_____ F U N C T I O N S ____________________________________________________*/
+
+/**-----------------------------------------------------------------------------
+ * @brief   Common initialization of pulse records
+ *
+ * @param   [in]  p      Address of the record calling this function
+ * @param   [in]  plink  Address of the record's INP field
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioInitRecord_pulse( struct dbCommon *p, struct link const* plink ){
+  p->pact = (epicsUInt8)true; /* disable record */
+
+  devGpio_rec_t conf = { plink,
+                         GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING,
+                         DEVGPIO_MODE_PULSE, true, true, PULSE_DEFAULT_RATE };
+  conf.quantity = DEVGPIO_PULSE_DUTY;
+  conf.stat = DEVGPIO_STAT_MEAN;
+  epicsUInt16 nobt = devGpioInitRecord( p, &conf );
+  if( 1 != nobt ) {
+    fprintf( stderr, "\033[31;1m%s: Invalid number of gpio lines: %u\033[0m\n",
+             p->name, nobt );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
+
+  devGpio_info_t *pinfo = (devGpio_info_t *)p->dpvt;
+  devGpio_pulse_rec_t *prp = calloc( 1, sizeof( devGpio_pulse_rec_t ) );
+  if( !prp ) {
+    fprintf( stderr, "\033[31;1m%s: Out of memory\033[0m\n", p->name );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
+  if( !pinfo->ext ) {
+    devGpio_pulse_t *ppulse = calloc( 1, sizeof( devGpio_pulse_t ) );
+    if( !ppulse ) {
+      fprintf( stderr, "\033[31;1m%s: Out of memory\033[0m\n", p->name );
+      free( prp );
+      devGpioReleaseRecord( p, &conf );
+      return ERROR;
+    }
+    ppulse->lock = epicsMutexMustCreate();
+    pinfo->ext = ppulse;
+  }
+
+  prp->pinfo = pinfo;
+  prp->quantity = conf.quantity;
+  prp->stat = conf.stat;
+  p->dpvt = prp;
+
+  p->udf = 0;
+  p->pact = (epicsUInt8)false; /* enable record */
+
+  return OK;
+}
+
+static long devGpioInitRecord_pulseLongin( struct dbCommon *p ){
+  return devGpioInitRecord_pulse( p, &((struct longinRecord *)p)->inp );
+}
+
+static long devGpioInitRecord_pulseAi( struct dbCommon *p ){
+  return devGpioInitRecord_pulse( p, &((struct aiRecord *)p)->inp );
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Get I/O Intr Information of pulse records
+ *----------------------------------------------------------------------------*/
+static long devGpioGetIoIntInfo_pulse( int cmd, struct dbCommon *p, IOSCANPVT *ppvt ){
+  devGpio_pulse_rec_t *prp = (devGpio_pulse_rec_t *)p->dpvt;
+  return devGpioIoIntInfo( cmd, prp->pinfo, ppvt );
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Get the selected statistic of the last window
+ *
+ * Windows without measurements raise a MAJOR soft alarm. The duty cycle of
+ * a line stuck at a level is 0 or 100 %, other quantities keep their value.
+ *
+ * @param   [in]  p       Address of the record calling this function
+ * @param   [out] pvalue  Value of the statistic
+ *
+ * @return  false if there is no value
+ *----------------------------------------------------------------------------*/
+static bool devGpioPulseValue( struct dbCommon *p, double *pvalue ) {
+  devGpio_pulse_rec_t *prp = (devGpio_pulse_rec_t *)p->dpvt;
+  devGpio_pulse_t *ppulse = (devGpio_pulse_t *)prp->pinfo->ext;
+  devGpioStormAlarm( p, prp->pinfo );
+
+  epicsMutexLock( ppulse->lock );
+  epicsUInt32 n = ppulse->pubN[prp->quantity];
+  double value = ppulse->pub[prp->quantity][prp->stat];
+  epicsUInt8 level = ppulse->pubLevel;
+  epicsMutexUnlock( ppulse->lock );
+
+  if( 0 == n ) {
+    recGblSetSevr( p, SOFT_ALARM, MAJOR_ALARM );
+    if( DEVGPIO_PULSE_DUTY != prp->quantity ) return false;
+    value = level ? 100. : 0.;
+  }
+  *pvalue = value;
+  return true;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of longin records
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_pulseLongin( struct longinRecord *prec ) {
+  double value;
+  if( devGpioPulseValue( (dbCommon *)prec, &value ) ) prec->val = (epicsInt32)( value + 0.5 );
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of ai records
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 2 (do not convert)
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_pulseAi( struct aiRecord *prec ) {
+  double value;
+  if( devGpioPulseValue( (dbCommon *)prec, &value ) ) {
+    prec->val = value;
+    prec->udf = 0;
+  }
+  return DO_NOT_CONVERT;
+}
@@ -0,0 +1,216 @@
+/*******************************************************************************
+ * Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+ *                    - Helmholtz-Institut Mainz
+ *
+ * This file is part of devGpio
+ *
+ * devGpio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * devGpio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * version 1.0.0; Aug 13, 2015
+ *
+*******************************************************************************/
+
+/**
+ * @file devGpioQuad.c
+ * @brief Device Support implementation for quadrature encoders
+ *
+ * Position is provided by longin and int64in records, velocity in counts
+ * per second by ai records. Edge events of the A/B lines are decoded by
+ * the interrupt handler.
+ */
+
+/*_____ I N C L U D E S ______________________________________________________*/
+
+/* ANSI C includes  */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <linux/gpio.h>
+
+/* EPICS includes */
+#include <aiRecord.h>
+#include <int64inRecord.h>
+#include <longinRecord.h>
+#include <alarm.h>
+#include <dbAccess.h>
+#include <epicsExport.h>
+#include <epicsTypes.h>
+#include <recGbl.h>
+
+/* local includes */
+#include "devGpio.h"
+
+/*_____ D E F I N I T I O N S ________________________________________________*/
+static long devGpioInitRecord_quad( struct dbCommon *p, struct link const* plink );
+static long devGpioInitRecord_quadLongin( struct dbCommon *p );
+static long devGpioInitRecord_quadInt64in( struct dbCommon *p );
+static long devGpioInitRecord_quadAi( struct dbCommon *p );
+static long devGpioRead_quadLongin( struct longinRecord *prec );
+static long devGpioRead_quadInt64in( struct int64inRecord *prec );
+static long devGpioRead_quadAi( struct aiRecord *prec );
+
+/* Default publish rate in Hz */
+#define QUAD_DEFAULT_RATE 10.
+
+/*_____ G L O B A L S ________________________________________________________*/
+
+longindset devGpioQuadLongin = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_quadLongin,
+    devGpioGetIoIntInfo
+  },
+  devGpioRead_quadLongin
+};
+epicsExportAddress( dset, devGpioQuadLongin );
+
+int64indset devGpioQuadInt64in = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_quadInt64in,
+    devGpioGetIoIntInfo
+  },
+  devGpioRead_quadInt64in
+};
+epicsExportAddress( dset, devGpioQuadInt64in );
+
+aidset devGpioQuadAi = {
+  {
+    6,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_quadAi,
+    devGpioGetIoIntInfo
+  },
+  devGpioRead_quadAi,
+  NULL
+};
+epicsExportAddress( dset, devGpioQuadAi );
+
+/*_____ L O C A L S __________________________________________________________*/
+
+/*_____ F U N C T I O N S ____________________________________________________*/
+
+/**-----------------------------------------------------------------------------
+ * @brief   Raise a minor alarm while the position may be wrong
+ *
+ * Edges are lost while edge detection is disabled by an interrupt storm,
+ * the position is correct again after the next index.
+ *----------------------------------------------------------------------------*/
+static void devGpioStaleAlarm( dbCommon *prec, devGpio_info_t const* pinfo ) {
+  if( __atomic_load_n( &((devGpio_quad_t const *)pinfo->ext)->stale, __ATOMIC_RELAXED ) )
+    recGblSetSevr( prec, HW_LIMIT_ALARM, MINOR_ALARM );
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Common initialization of quadrature encoder records
+ *
+ * @param   [in]  p      Address of the record calling this function
+ * @param   [in]  plink  Address of the record's INP field
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioInitRecord_quad( struct dbCommon *p, struct link const* plink ){
+  p->pact = (epicsUInt8)true; /* disable record */
+
+  devGpio_rec_t conf = { plink,
+                         GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING,
+                         DEVGPIO_MODE_QUAD, true, true, QUAD_DEFAULT_RATE };
+  epicsUInt16 nobt = devGpioInitRecord( p, &conf );
+  if( 2 != nobt && 3 != nobt ) {
+    fprintf( stderr, "\033[31;1m%s: Invalid number of gpio lines: %u\033[0m\n",
+             p->name, nobt );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
+
+  devGpio_info_t *pinfo = (devGpio_info_t *)p->dpvt;
+  if( !pinfo->ext ) {
+    pinfo->ext = calloc( 1, sizeof( devGpio_quad_t ) );
+    if( !pinfo->ext ) {
+      fprintf( stderr, "\033[31;1m%s: Out of memory\033[0m\n", p->name );
+      devGpioReleaseRecord( p, &conf );
+      return ERROR;
+    }
+  }
+
+  p->udf = 0;
+  p->pact = (epicsUInt8)false; /* enable record */
+
+  return OK;
+}
+
+static long devGpioInitRecord_quadLongin( struct dbCommon *p ){
+  return devGpioInitRecord_quad( p, &((struct longinRecord *)p)->inp );
+}
+
+static long devGpioInitRecord_quadInt64in( struct dbCommon *p ){
+  return devGpioInitRecord_quad( p, &((struct int64inRecord *)p)->inp );
+}
+
+static long devGpioInitRecord_quadAi( struct dbCommon *p ){
+  return devGpioInitRecord_quad( p, &((struct aiRecord *)p)->inp );
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of longin records (position)
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_quadLongin( struct longinRecord *prec ) {
+  devGpio_info_t *pinfo = (devGpio_info_t *)prec->dpvt;
+  devGpioStormAlarm( (dbCommon *)prec, pinfo );
+  devGpioStaleAlarm( (dbCommon *)prec, pinfo );
+  prec->val = (epicsInt32)__atomic_load_n( &((devGpio_quad_t *)pinfo->ext)->position, __ATOMIC_RELAXED );
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of int64in records (position)
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_quadInt64in( struct int64inRecord *prec ) {
+  devGpio_info_t *pinfo = (devGpio_info_t *)prec->dpvt;
+  devGpioStormAlarm( (dbCommon *)prec, pinfo );
+  devGpioStaleAlarm( (dbCommon *)prec, pinfo );
+  prec->val = __atomic_load_n( &((devGpio_quad_t *)pinfo->ext)->position, __ATOMIC_RELAXED );
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of ai records (velocity in counts per second)
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 2 (do not convert)
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_quadAi( struct aiRecord *prec ) {
+  devGpio_info_t *pinfo = (devGpio_info_t *)prec->dpvt;
+  devGpioStormAlarm( (dbCommon *)prec, pinfo );
+  double velocity;
+  __atomic_load( &((devGpio_quad_t *)pinfo->ext)->pubVelocity, &velocity, __ATOMIC_RELAXED );
+  prec->val = velocity;
+  prec->udf = 0;
+  return DO_NOT_CONVERT;
+}
@@ -0,0 +1,234 @@
+/*******************************************************************************
+ * Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+ *                    - Helmholtz-Institut Mainz
+ *
+ * This file is part of devGpio
+ *
+ * devGpio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * devGpio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * version 1.0.0; Aug 13, 2015
+ *
+*******************************************************************************/
+
+/**
+ * @file devGpioQueue.c
+ * @brief Device Support implementation for sequences of time-tagged outputs
+ *
+ * Waveform records holding pairs of (time in us, value). Processing the
+ * record queues one command per pair for the lines of a devGpio output
+ * record. Times are relative to the processing of the waveform or to the
+ * last edge of a trigger record.
+ */
+
+/*_____ I N C L U D E S ______________________________________________________*/
+
+/* ANSI C includes  */
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/gpio.h>
+
+/* EPICS includes */
+#include <waveformRecord.h>
+#include <alarm.h>
+#include <dbAccess.h>
+#include <epicsExport.h>
+#include <epicsTypes.h>
+#include <link.h>
+#include <menuFtype.h>
+#include <recGbl.h>
+
+/* local includes */
+#include "devGpio.h"
+
+/*_____ D E F I N I T I O N S ________________________________________________*/
+
+/**
+ * @brief Private data of sequence records
+ */
+typedef struct devGpio_queue {
+  char output[64];              /**< Name of the output record */
+  char trigger[64];             /**< Name of the trigger record, empty for none */
+  devGpio_info_t *pinfo;        /**< Line request of the output, resolved at iocInit */
+  devGpio_info_t *ptrig;        /**< Line request of the trigger, resolved at iocInit */
+  dbCommon *prec;               /**< Sequence record */
+  struct devGpio_queue *next;   /**< Next sequence record */
+} devGpio_queue_t;
+
+static long devGpioInit_queue( int after );
+static long devGpioInitRecord_queue( struct dbCommon *p );
+static long devGpioRead_queue( struct waveformRecord *prec );
+
+/*_____ G L O B A L S ________________________________________________________*/
+
+wfdset devGpioQueueWf = {
+  {
+    5,
+    NULL,
+    devGpioInit_queue,
+    devGpioInitRecord_queue,
+    NULL
+  },
+  devGpioRead_queue
+};
+epicsExportAddress( dset, devGpioQueueWf );
+
+/*_____ L O C A L S __________________________________________________________*/
+
+static devGpio_queue_t *queueList = NULL;
+
+/*_____ F U N C T I O N S ____________________________________________________*/
+
+/**-----------------------------------------------------------------------------
+ * @brief   Initialization of device support
+ *
+ * After the records have been initialized, the output and trigger records
+ * of all sequences are resolved and the triggers are armed, so their edges
+ * are seen before the first processing.
+ *
+ * @param   [in]  after  flag telling if function is called after or before
+ *                       record initialization
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioInit_queue( int after ) {
+  long status = devGpioInit( after );
+  if( 1 != after || OK != status ) return status;
+
+  for( devGpio_queue_t *pqueue = queueList; pqueue; pqueue = pqueue->next ) {
+    if( pqueue->pinfo ) continue;
+    devGpio_info_t *pinfo = devGpioLookup( pqueue->output );
+    if( pinfo && ( DEVGPIO_MODE_LEVELS != pinfo->mode || !( pinfo->cold->flags & GPIO_V2_LINE_FLAG_OUTPUT ) ) ) {
+      fprintf( stderr, "\033[31;1m%s: %s is not a devGpio output record\033[0m\n",
+               pqueue->prec->name, pqueue->output );
+      pinfo = NULL;
+    }
+    if( pinfo && pqueue->trigger[0] ) {
+      pqueue->ptrig = devGpioLookupTrigger( pqueue->trigger );
+      if( !pqueue->ptrig ) pinfo = NULL;
+    }
+    pqueue->pinfo = pinfo;
+  }
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Initialization of sequence records
+ *
+ * The syntax of the INP field is "@<OUTPUT> [TRIGGER=<RECORD>]".
+ *
+ * @param   [in]  p   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioInitRecord_queue( struct dbCommon *p ){
+  struct waveformRecord *prec = (struct waveformRecord *)p;
+  prec->pact = (epicsUInt8)true; /* disable record */
+
+  if( INST_IO != prec->inp.type ) {
+    fprintf( stderr, "\033[31;1m%s: Invalid link type for INP field: %s\033[0m\n",
+             prec->name, pamaplinkType[prec->inp.type].strvalue );
+    return ERROR;
+  }
+  if( menuFtypeDOUBLE != prec->ftvl || 2 > prec->nelm ) {
+    fprintf( stderr, "\033[31;1m%s: FTVL has to be DOUBLE with room for pairs of time and value\033[0m\n",
+             prec->name );
+    return ERROR;
+  }
+
+  devGpio_queue_t *pqueue = calloc( 1, sizeof( devGpio_queue_t ) );
+  if( !pqueue ) {
+    fprintf( stderr, "\033[31;1m%s: Out of memory\033[0m\n", prec->name );
+    return ERROR;
+  }
+
+  char option[80] = "";
+  int n = sscanf( prec->inp.value.instio.string, "%63s %79s", pqueue->output, option );
+  if( 1 > n || ( 2 == n && ( 0 != strncasecmp( option, "TRIGGER=", 8 ) || 63 < strlen( option + 8 ) ) ) ) {
+    fprintf( stderr, "\033[31;1m%s: Invalid INP field: %s\n"
+                     "    Syntax is \"@<OUTPUT> [TRIGGER=<RECORD>]\"\033[0m\n",
+             prec->name, prec->inp.value.instio.string );
+    free( pqueue );
+    return ERROR;
+  }
+  if( 2 == n ) strcpy( pqueue->trigger, option + 8 );
+  if( OK != devGpioSchedulerInit() ) {
+    free( pqueue );
+    return ERROR;
+  }
+  pqueue->prec = p;
+  pqueue->next = queueList;
+  queueList = pqueue;
+  prec->dpvt = pqueue;
+
+  prec->udf = 0;
+  prec->pact = (epicsUInt8)false; /* enable record */
+
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of sequence records
+ *
+ * Queues one command per pair of time and value. The output record has to
+ * be a devGpio record driving output lines. All pairs are checked before
+ * the first command is queued.
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_queue( struct waveformRecord *prec ) {
+  devGpio_queue_t *pqueue = (devGpio_queue_t *)prec->dpvt;
+  if( !pqueue->pinfo ) {
+    recGblSetSevr( prec, READ_ALARM, INVALID_ALARM );
+    return ERROR;
+  }
+
+  epicsUInt64 base = devGpioScheduleBase( pqueue->ptrig );
+  if( 0 == base ) {
+    fprintf( stderr, "\033[31;1m%s: Trigger %s has not fired yet\033[0m\n",
+             prec->name, pqueue->trigger );
+    recGblSetSevr( prec, READ_ALARM, INVALID_ALARM );
+    return ERROR;
+  }
+
+  double const *pairs = (double const *)prec->bptr;
+  epicsUInt64 mask = devGpioMask( pqueue->pinfo->nlines );
+  double maxTime = ( (double)( ~0ull - base ) ) / 1e3;
+  for( epicsUInt32 i = 0; i + 1 < prec->nord; i += 2 ) {
+    if( !isfinite( pairs[i] ) || 0. > pairs[i] || maxTime <= pairs[i] ) {
+      fprintf( stderr, "\033[31;1m%s: Invalid time %g\033[0m\n", prec->name, pairs[i] );
+      recGblSetSevr( prec, READ_ALARM, INVALID_ALARM );
+      return ERROR;
+    }
+    if( !isfinite( pairs[i + 1] ) || 0. > pairs[i + 1] || (double)mask + 1. <= pairs[i + 1] ) {
+      fprintf( stderr, "\033[31;1m%s: Invalid value %g\033[0m\n", prec->name, pairs[i + 1] );
+      recGblSetSevr( prec, READ_ALARM, INVALID_ALARM );
+      return ERROR;
+    }
+  }
+
+  for( epicsUInt32 i = 0; i + 1 < prec->nord; i += 2 ) {
+    epicsUInt64 deadline = base + (epicsUInt64)( pairs[i] * 1e3 );
+    if( OK != devGpioSchedule( pqueue->pinfo, deadline, (epicsUInt64)pairs[i + 1], mask ) ) {
+      recGblSetSevr( prec, READ_ALARM, MAJOR_ALARM );
+      return ERROR;
+    }
+  }
+  return OK;
+}
@@ -0,0 +1,316 @@
+/*******************************************************************************
+ * Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+ *                    - Helmholtz-Institut Mainz
+ *
+ * This file is part of devGpio
+ *
+ * devGpio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * devGpio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * version 1.0.0; Aug 13, 2015
+ *
+*******************************************************************************/
+
+/**
+ * @file devGpioSampler.c
+ * @brief Device Support implementation for periodic sampling
+ *
+ * A thread per waveform record reads all lines of the record's line request
+ * with a single ioctl per tick, timed by absolute deadlines. Samples are
+ * packed into elements of the waveform's FTVL (bit 0 = first GPIO) and
+ * collected in a double buffer. Full blocks are published via I/O Intr.
+ */
+
+/*_____ I N C L U D E S ______________________________________________________*/
+
+/* ANSI C includes  */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <linux/gpio.h>
+#include <sys/ioctl.h>
+
+/* EPICS includes */
+#include <waveformRecord.h>
+#include <alarm.h>
+#include <dbAccess.h>
+#include <epicsExport.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsTypes.h>
+#include <menuFtype.h>
+#include <recGbl.h>
+
+/* local includes */
+#include "devGpio.h"
+
+/*_____ D E F I N I T I O N S ________________________________________________*/
+
+/**
+ * @brief Periodic sampler of a line request
+ */
+typedef struct {
+  dbCommon *prec;           /**< Waveform record receiving the samples */
+  devGpio_info_t *pinfo;    /**< Line request */
+  epicsUInt64 period_ns;    /**< Sampling period */
+  epicsUInt32 nsamples;     /**< Samples per block */
+  epicsUInt32 size;         /**< Size of a single sample in bytes */
+  epicsUInt8 *buffer[2];    /**< Double buffer of sample blocks */
+  epicsUInt32 active;       /**< Buffer being filled */
+  epicsUInt32 nbad[2];      /**< Samples of a buffer which could not be read */
+  bool consumed;            /**< Published block has been read by the record */
+  epicsMutexId lock;        /**< Protects swapping of the buffers */
+  epicsUInt64 nblocks;      /**< Number of published blocks */
+  epicsUInt64 noverruns;    /**< Blocks published before the previous one was read */
+  epicsUInt64 nmissed;      /**< Ticks missed because of late wakeups */
+  epicsUInt64 nreadErrors;  /**< Failed reads of the lines */
+  epicsUInt64 nticks;       /**< Number of samples taken */
+  epicsUInt64 jitterMax;    /**< Maximum wakeup latency in ns */
+  epicsUInt64 jitterSum;    /**< Sum of wakeup latencies in ns */
+  epicsUInt64 lastOverruns; /**< Overruns at last read of the record */
+} devGpio_sampler_t;
+
+static long devGpioInitRecord_sampler( struct dbCommon *p );
+static long devGpioRead_sampler( struct waveformRecord *prec );
+
+/*_____ G L O B A L S ________________________________________________________*/
+
+wfdset devGpioSamplerWf = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_sampler,
+    devGpioGetIoIntInfo
+  },
+  devGpioRead_sampler
+};
+epicsExportAddress( dset, devGpioSamplerWf );
+
+/*_____ L O C A L S __________________________________________________________*/
+
+/*_____ F U N C T I O N S ____________________________________________________*/
+
+/**-----------------------------------------------------------------------------
+ * @brief   Convert timespec into ns
+ *----------------------------------------------------------------------------*/
+static inline epicsUInt64 timespec2ns( struct timespec const *ts ) {
+  return (epicsUInt64)ts->tv_sec * 1000000000ull + ts->tv_nsec;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Free a sampler which did not start
+ *----------------------------------------------------------------------------*/
+static void samplerFree( devGpio_sampler_t *psampler ) {
+  if( psampler->lock ) epicsMutexDestroy( psampler->lock );
+  free( psampler->buffer[0] );
+  free( psampler->buffer[1] );
+  free( psampler );
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Sampling thread
+ *
+ * Sleeps until the absolute deadline of the next tick, so the sampling rate
+ * does not drift with the time needed for reading. Ticks which are missed
+ * completely are skipped and counted.
+ *----------------------------------------------------------------------------*/
+static void samplerThread( void *parm ) {
+  devGpio_sampler_t *psampler = (devGpio_sampler_t *)parm;
+  devGpio_info_t *pinfo = psampler->pinfo;
+  struct gpio_v2_line_values values = { 0, devGpioMask( pinfo->nlines ) };
+  epicsUInt32 fill = 0;
+  struct timespec deadline;
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, &deadline );
+  epicsUInt64 next = timespec2ns( &deadline );
+
+  while( true ) {
+    next += psampler->period_ns;
+    deadline.tv_sec = next / 1000000000ull;
+    deadline.tv_nsec = next % 1000000000ull;
+    while( EINTR == clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL ) );
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    epicsUInt64 late = timespec2ns( &now ) - next;
+    if( late > psampler->jitterMax ) psampler->jitterMax = late;
+    psampler->jitterSum += late;
+    psampler->nticks++;
+    if( late >= psampler->period_ns ) {
+      epicsUInt64 missed = late / psampler->period_ns;
+      psampler->nmissed += missed;
+      next += missed * psampler->period_ns;
+    }
+
+    /* a failed read repeats the previous sample and invalidates the block */
+    if( -1 == ioctl( pinfo->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values ) ) {
+      psampler->nreadErrors++;
+      psampler->nbad[psampler->active]++;
+    }
+
+    epicsUInt8 *pdst = psampler->buffer[psampler->active] + fill * psampler->size;
+    switch( psampler->size ) {
+      case 1:  *pdst = (epicsUInt8)values.bits; break;
+      case 2:  *(epicsUInt16 *)pdst = (epicsUInt16)values.bits; break;
+      case 4:  *(epicsUInt32 *)pdst = (epicsUInt32)values.bits; break;
+      default: *(epicsUInt64 *)pdst = values.bits; break;
+    }
+    if( ++fill < psampler->nsamples ) continue;
+
+    /* publish the full block and continue in the other buffer */
+    fill = 0;
+    epicsMutexLock( psampler->lock );
+    if( !psampler->consumed && 0 != psampler->nblocks ) psampler->noverruns++;
+    psampler->active ^= 1u;
+    psampler->nbad[psampler->active] = 0;
+    psampler->consumed = false;
+    psampler->nblocks++;
+    epicsMutexUnlock( psampler->lock );
+    scanIoRequest( pinfo->ioscanpvt );
+  }
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Initialization of waveform records
+ *
+ * @param   [in]  p   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioInitRecord_sampler( struct dbCommon *p ){
+  struct waveformRecord *prec = (struct waveformRecord *)p;
+  prec->pact = (epicsUInt8)true; /* disable record */
+
+  epicsUInt32 size;
+  switch( prec->ftvl ) {
+    case menuFtypeCHAR:
+    case menuFtypeUCHAR:  size = 1; break;
+    case menuFtypeSHORT:
+    case menuFtypeUSHORT: size = 2; break;
+    case menuFtypeLONG:
+    case menuFtypeULONG:  size = 4; break;
+    case menuFtypeINT64:
+    case menuFtypeUINT64: size = 8; break;
+    default:
+      fprintf( stderr, "\033[31;1m%s: FTVL has to be an integer type\033[0m\n", prec->name );
+      return ERROR;
+  }
+
+  devGpio_rec_t conf = { &prec->inp, GPIO_V2_LINE_FLAG_INPUT, DEVGPIO_MODE_SAMPLER, false, false, 0. };
+  epicsUInt16 nobt = devGpioInitRecord( p, &conf );
+  if( 1u > nobt || size * 8 < nobt ) {
+    fprintf( stderr, "\033[31;1m%s: Invalid number of gpio lines: %u\033[0m\n",
+             prec->name, nobt );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
+  devGpio_info_t *pinfo = (devGpio_info_t *)p->dpvt;
+  if( 0 == pinfo->period_ns ) {
+    fprintf( stderr, "\033[31;1m%s: Sampling rate (RATE=<Hz>) missing\033[0m\n", prec->name );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
+
+  devGpio_sampler_t *psampler = calloc( 1, sizeof( devGpio_sampler_t ) );
+  if( !psampler ) {
+    fprintf( stderr, "\033[31;1m%s: Out of memory\033[0m\n", prec->name );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
+  psampler->buffer[0] = calloc( prec->nelm, size );
+  psampler->buffer[1] = calloc( prec->nelm, size );
+  psampler->lock = epicsMutexCreate();
+  if( !psampler->buffer[0] || !psampler->buffer[1] || !psampler->lock ) {
+    fprintf( stderr, "\033[31;1m%s: Out of memory\033[0m\n", prec->name );
+    samplerFree( psampler );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
+  psampler->prec = p;
+  psampler->pinfo = pinfo;
+  psampler->period_ns = pinfo->period_ns;
+  psampler->nsamples = prec->nelm;
+  psampler->size = size;
+  psampler->consumed = true;
+
+  if( !epicsThreadCreate( prec->name, devGpioSamplerPriority,
+                          epicsThreadGetStackSize( epicsThreadStackSmall ),
+                          samplerThread, psampler ) ) {
+    fprintf( stderr, "\033[31;1m%s: Could not start sampling thread\033[0m\n", prec->name );
+    samplerFree( psampler );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
+  pinfo->ext = psampler;
+
+  prec->pact = (epicsUInt8)false; /* enable record */
+
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of waveform records
+ *
+ * Copies the last published block. Raises a minor alarm if blocks were
+ * dropped since the last read, an invalid alarm if the lines could not be
+ * read for some samples of the block.
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_sampler( struct waveformRecord *prec ) {
+  devGpio_sampler_t *psampler = (devGpio_sampler_t *)((devGpio_info_t *)prec->dpvt)->ext;
+
+  epicsMutexLock( psampler->lock );
+  if( 0 == psampler->nblocks ) {
+    epicsMutexUnlock( psampler->lock );
+    return OK;
+  }
+  memcpy( prec->bptr, psampler->buffer[psampler->active ^ 1u], psampler->nsamples * psampler->size );
+  psampler->consumed = true;
+  epicsUInt64 noverruns = psampler->noverruns;
+  epicsUInt32 nbad = psampler->nbad[psampler->active ^ 1u];
+  epicsMutexUnlock( psampler->lock );
+
+  prec->nord = psampler->nsamples;
+  prec->udf = 0;
+  if( noverruns != psampler->lastOverruns ) {
+    psampler->lastOverruns = noverruns;
+    recGblSetSevr( prec, SOFT_ALARM, MINOR_ALARM );
+  }
+  if( 0 != nbad ) recGblSetSevr( prec, READ_ALARM, INVALID_ALARM );
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Print statistics of a sampler
+ *
+ * @param   [in]  pinfo  Address of the line request
+ *----------------------------------------------------------------------------*/
+void devGpioSamplerReport( devGpio_info_t const* pinfo ) {
+  devGpio_sampler_t const *psampler = (devGpio_sampler_t const *)pinfo->ext;
+  if( !psampler ) return;
+  printf( ", blocks %llu, overruns %llu, missed ticks %llu, read errors %llu,"
+          " jitter max %.1f us mean %.1f us",
+          (unsigned long long)psampler->nblocks, (unsigned long long)psampler->noverruns,
+          (unsigned long long)psampler->nmissed, (unsigned long long)psampler->nreadErrors,
+          psampler->jitterMax * 1e-3,
+          psampler->nticks ? psampler->jitterSum * 1e-3 / psampler->nticks : 0. );
+  fflush( stdout );
+}
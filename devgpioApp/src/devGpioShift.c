@@ -0,0 +1,465 @@
+/*******************************************************************************
+ * Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+ *                    - Helmholtz-Institut Mainz
+ *
+ * This file is part of devGpio
+ *
+ * devGpio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * devGpio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * version 1.0.0; Aug 13, 2015
+ *
+*******************************************************************************/
+
+/**
+ * @file devGpioShift.c
+ * @brief Device Support implementation for shift registers
+ *
+ * Daisy-chained shift registers (74HC595 style outputs, 74HC165 style
+ * inputs) are clocked by a dedicated thread using the record's line
+ * request. The records are processed asynchronously, once per transfer.
+ */
+
+/*_____ I N C L U D E S ______________________________________________________*/
+
+/* ANSI C includes  */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/gpio.h>
+#include <sys/ioctl.h>
+
+/* EPICS includes */
+#include <int64inRecord.h>
+#include <int64outRecord.h>
+#include <longinRecord.h>
+#include <longoutRecord.h>
+#include <waveformRecord.h>
+#include <alarm.h>
+#include <callback.h>
+#include <dbAccess.h>
+#include <epicsExport.h>
+#include <epicsMessageQueue.h>
+#include <epicsThread.h>
+#include <epicsTypes.h>
+#include <menuFtype.h>
+#include <recGbl.h>
+
+/* local includes */
+#include "devGpio.h"
+
+/*_____ D E F I N I T I O N S ________________________________________________*/
+
+/* Lines of the line request, in order of the INP/OUT field */
+#define SHIFT_DATA    ( 1ull << 0 )
+#define SHIFT_CLOCK   ( 1ull << 1 )
+#define SHIFT_LATCH   ( 1ull << 2 )
+
+/* Maximum number of pending transfers */
+#define SHIFT_QUEUE_SIZE 64
+
+/**
+ * @brief Transfer of a shift register chain
+ */
+typedef struct {
+  dbCommon *prec;       /**< Record requesting the transfer */
+  int fd;               /**< File descriptor of the line request */
+  epicsUInt32 nbits;    /**< Length of the chain */
+  bool lsb;             /**< Shift LSB first */
+  bool input;           /**< Shift in (74HC165) instead of out (74HC595) */
+  long status;          /**< Result of the last transfer */
+  epicsUInt8 *buffer;   /**< Bits of the chain, bit 0 is LSB of buffer[0] */
+  CALLBACK callback;    /**< Callback processing the record after the transfer */
+} devGpio_shift_t;
+
+static long devGpioInitRecord_shift( struct dbCommon *p, struct link const* plink,
+                                     epicsUInt64 inmask, epicsUInt32 maxbits, bool output );
+static long devGpioInitRecord_shiftLongin( struct dbCommon *p );
+static long devGpioInitRecord_shiftLongout( struct dbCommon *p );
+static long devGpioInitRecord_shiftInt64in( struct dbCommon *p );
+static long devGpioInitRecord_shiftInt64out( struct dbCommon *p );
+static long devGpioInitRecord_shiftWf( struct dbCommon *p );
+static long devGpioRead_shiftLongin( struct longinRecord *prec );
+static long devGpioWrite_shiftLongout( struct longoutRecord *prec );
+static long devGpioRead_shiftInt64in( struct int64inRecord *prec );
+static long devGpioWrite_shiftInt64out( struct int64outRecord *prec );
+static long devGpioRead_shiftWf( struct waveformRecord *prec );
+
+/*_____ G L O B A L S ________________________________________________________*/
+
+longindset devGpioShiftLongin = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_shiftLongin,
+    NULL
+  },
+  devGpioRead_shiftLongin
+};
+epicsExportAddress( dset, devGpioShiftLongin );
+
+longoutdset devGpioShiftLongout = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_shiftLongout,
+    NULL
+  },
+  devGpioWrite_shiftLongout
+};
+epicsExportAddress( dset, devGpioShiftLongout );
+
+int64indset devGpioShiftInt64in = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_shiftInt64in,
+    NULL
+  },
+  devGpioRead_shiftInt64in
+};
+epicsExportAddress( dset, devGpioShiftInt64in );
+
+int64outdset devGpioShiftInt64out = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_shiftInt64out,
+    NULL
+  },
+  devGpioWrite_shiftInt64out
+};
+epicsExportAddress( dset, devGpioShiftInt64out );
+
+wfdset devGpioShiftWf = {
+  {
+    5,
+    NULL,
+    devGpioInit,
+    devGpioInitRecord_shiftWf,
+    NULL
+  },
+  devGpioRead_shiftWf
+};
+epicsExportAddress( dset, devGpioShiftWf );
+
+/*_____ L O C A L S __________________________________________________________*/
+static epicsMessageQueueId shiftQueue = NULL;
+
+/*_____ F U N C T I O N S ____________________________________________________*/
+
+/**-----------------------------------------------------------------------------
+ * @brief   Set the lines given by mask
+ *----------------------------------------------------------------------------*/
+static inline int shiftSet( int fd, epicsUInt64 bits, epicsUInt64 mask ) {
+  struct gpio_v2_line_values values = { bits, mask };
+  return ioctl( fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values );
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Clock a chain of bits in or out
+ *
+ * Out: data is set together with the falling clock, shifted on the rising
+ * clock and transferred to the outputs by a pulse on the latch line.
+ * In: the inputs are loaded by pulling the latch (parallel load) line low,
+ * each bit is read before the rising clock shifts the next one.
+ *
+ * @param   [in]  pshift  Address of the transfer
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long shiftTransfer( devGpio_shift_t *pshift ) {
+  int fd = pshift->fd;
+  epicsUInt32 k;
+
+  if( pshift->input ) {
+    if( -1 == shiftSet( fd, 0, SHIFT_LATCH | SHIFT_CLOCK ) ) return ERROR;
+    if( -1 == shiftSet( fd, SHIFT_LATCH, SHIFT_LATCH ) ) return ERROR;
+    memset( pshift->buffer, 0, ( pshift->nbits + 7 ) / 8 );
+  }
+
+  for( k = 0; k < pshift->nbits; ++k ) {
+    epicsUInt32 bit = pshift->lsb ? k : pshift->nbits - 1 - k;
+    if( pshift->input ) {
+      struct gpio_v2_line_values values = { 0, SHIFT_DATA };
+      if( -1 == ioctl( fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values ) ) return ERROR;
+      if( values.bits & SHIFT_DATA ) pshift->buffer[bit / 8] |= (epicsUInt8)( 1u << ( bit % 8 ) );
+      if( -1 == shiftSet( fd, SHIFT_CLOCK, SHIFT_CLOCK ) ) return ERROR;
+      if( -1 == shiftSet( fd, 0, SHIFT_CLOCK ) ) return ERROR;
+    } else {
+      bool high = pshift->buffer[bit / 8] & ( 1u << ( bit % 8 ) );
+      if( -1 == shiftSet( fd, high ? SHIFT_DATA : 0, SHIFT_DATA | SHIFT_CLOCK ) ) return ERROR;
+      if( -1 == shiftSet( fd, SHIFT_CLOCK, SHIFT_CLOCK ) ) return ERROR;
+    }
+  }
+
+  if( !pshift->input ) {
+    if( -1 == shiftSet( fd, SHIFT_LATCH, SHIFT_LATCH | SHIFT_CLOCK ) ) return ERROR;
+    if( -1 == shiftSet( fd, 0, SHIFT_LATCH ) ) return ERROR;
+  }
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Thread performing the transfers
+ *----------------------------------------------------------------------------*/
+static void shiftThread( void *parm ) {
+  devGpio_shift_t *pshift;
+  (void)parm;
+
+  while( true ) {
+    if( sizeof( pshift ) != epicsMessageQueueReceive( shiftQueue, &pshift, sizeof( pshift ) ) )
+      continue;
+    pshift->status = shiftTransfer( pshift );
+    if( OK != pshift->status ) {
+      fprintf( stderr, "\033[31;1m%s: Could not clock shift register: %s\033[0m\n",
+               pshift->prec->name, strerror( errno ) );
+    }
+    callbackRequestProcessCallback( &pshift->callback, priorityHigh, pshift->prec );
+  }
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Common initialization of shift register records
+ *
+ * @param   [in]  p        Address of the record calling this function
+ * @param   [in]  plink    Address of the record's INP/OUT field
+ * @param   [in]  inmask   Lines requested as input
+ * @param   [in]  maxbits  Maximum length of the chain supported by the record
+ * @param   [in]  output   Record only clocks its value out, IN is not allowed
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioInitRecord_shift( struct dbCommon *p, struct link const* plink,
+                                     epicsUInt64 inmask, epicsUInt32 maxbits, bool output ){
+  p->pact = (epicsUInt8)true; /* disable record */
+
+  devGpio_rec_t conf = { plink, GPIO_V2_LINE_FLAG_OUTPUT, DEVGPIO_MODE_SHIFT, false, false, 0.,
+                         inmask, maxbits, false };
+  conf.outonly = output;
+  epicsUInt16 nobt = devGpioInitRecord( p, &conf );
+  if( 3 != nobt ) {
+    fprintf( stderr, "\033[31;1m%s: Invalid number of gpio lines: %u\033[0m\n",
+             p->name, nobt );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
+  if( conf.nbits > maxbits ) {
+    fprintf( stderr, "\033[31;1m%s: Invalid number of bits: %u\033[0m\n",
+             p->name, conf.nbits );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
+
+  if( !shiftQueue ) {
+    shiftQueue = epicsMessageQueueCreate( SHIFT_QUEUE_SIZE, sizeof( devGpio_shift_t* ) );
+    if( !shiftQueue ) {
+      fprintf( stderr, "\033[31;1m%s: Could not create transfer queue\033[0m\n", p->name );
+      devGpioReleaseRecord( p, &conf );
+      return ERROR;
+    }
+    if( !epicsThreadCreate( "devGpioShift", epicsThreadPriorityHigh,
+                            epicsThreadGetStackSize( epicsThreadStackSmall ),
+                            shiftThread, NULL ) ) {
+      fprintf( stderr, "\033[31;1m%s: Could not start transfer thread\033[0m\n", p->name );
+      epicsMessageQueueDestroy( shiftQueue );
+      shiftQueue = NULL;
+      devGpioReleaseRecord( p, &conf );
+      return ERROR;
+    }
+  }
+
+  devGpio_info_t *pinfo = (devGpio_info_t *)p->dpvt;
+  devGpio_shift_t *pshift = calloc( 1, sizeof( devGpio_shift_t ) );
+  if( !pshift ) {
+    fprintf( stderr, "\033[31;1m%s: Out of memory\033[0m\n", p->name );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
+  pshift->buffer = calloc( ( conf.nbits + 7 ) / 8, 1 );
+  if( !pshift->buffer ) {
+    fprintf( stderr, "\033[31;1m%s: Out of memory\033[0m\n", p->name );
+    free( pshift );
+    devGpioReleaseRecord( p, &conf );
+    return ERROR;
+  }
+  pshift->prec = p;
+  pshift->fd = pinfo->fd;
+  pshift->nbits = conf.nbits;
+  pshift->lsb = conf.lsb;
+  pshift->input = ( 0 != conf.inmask );
+  pinfo->ext = pshift;
+
+  p->udf = 0;
+  p->pact = (epicsUInt8)false; /* enable record */
+
+  return OK;
+}
+
+static long devGpioInitRecord_shiftLongin( struct dbCommon *p ){
+  return devGpioInitRecord_shift( p, &((struct longinRecord *)p)->inp, SHIFT_DATA, 32, false );
+}
+
+static long devGpioInitRecord_shiftLongout( struct dbCommon *p ){
+  return devGpioInitRecord_shift( p, &((struct longoutRecord *)p)->out, 0, 32, true );
+}
+
+static long devGpioInitRecord_shiftInt64in( struct dbCommon *p ){
+  return devGpioInitRecord_shift( p, &((struct int64inRecord *)p)->inp, SHIFT_DATA, 64, false );
+}
+
+static long devGpioInitRecord_shiftInt64out( struct dbCommon *p ){
+  return devGpioInitRecord_shift( p, &((struct int64outRecord *)p)->out, 0, 64, true );
+}
+
+static long devGpioInitRecord_shiftWf( struct dbCommon *p ){
+  struct waveformRecord *prec = (struct waveformRecord *)p;
+  if( menuFtypeUCHAR != prec->ftvl && menuFtypeCHAR != prec->ftvl ) {
+    fprintf( stderr, "\033[31;1m%s: FTVL has to be CHAR or UCHAR\033[0m\n", prec->name );
+    return ERROR;
+  }
+  return devGpioInitRecord_shift( p, &prec->inp, 0, prec->nelm * 8, false );
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Start or complete an asynchronous transfer
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioShiftProcess( struct dbCommon *prec ) {
+  devGpio_shift_t *pshift = (devGpio_shift_t *)((devGpio_info_t *)prec->dpvt)->ext;
+
+  if( prec->pact ) {
+    /* transfer completed */
+    if( OK != pshift->status )
+      recGblSetSevr( prec, pshift->input ? READ_ALARM : WRITE_ALARM, INVALID_ALARM );
+    return pshift->status;
+  }
+
+  if( 0 != epicsMessageQueueTrySend( shiftQueue, &pshift, sizeof( pshift ) ) ) {
+    recGblSetSevr( prec, pshift->input ? READ_ALARM : WRITE_ALARM, INVALID_ALARM );
+    return ERROR;
+  }
+  prec->pact = (epicsUInt8)true;
+  return OK;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Copy a value into the transfer buffer
+ *----------------------------------------------------------------------------*/
+static void shiftPack( devGpio_shift_t *pshift, epicsUInt64 value ) {
+  epicsUInt32 i;
+  for( i = 0; i < ( pshift->nbits + 7 ) / 8; ++i ) pshift->buffer[i] = (epicsUInt8)( value >> ( 8 * i ) );
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Get a value from the transfer buffer
+ *----------------------------------------------------------------------------*/
+static epicsUInt64 shiftUnpack( devGpio_shift_t const *pshift ) {
+  epicsUInt64 value = 0;
+  epicsUInt32 i;
+  for( i = 0; i < ( pshift->nbits + 7 ) / 8; ++i ) value |= (epicsUInt64)pshift->buffer[i] << ( 8 * i );
+  return value;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of longin records
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_shiftLongin( struct longinRecord *prec ) {
+  devGpio_shift_t *pshift = (devGpio_shift_t *)((devGpio_info_t *)prec->dpvt)->ext;
+  bool done = prec->pact;
+  long status = devGpioShiftProcess( (struct dbCommon *)prec );
+  if( done && OK == status ) prec->val = (epicsInt32)(epicsUInt32)shiftUnpack( pshift );
+  return status;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Write routine of longout records
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioWrite_shiftLongout( struct longoutRecord *prec ) {
+  devGpio_shift_t *pshift = (devGpio_shift_t *)((devGpio_info_t *)prec->dpvt)->ext;
+  if( !prec->pact ) shiftPack( pshift, (epicsUInt32)prec->val );
+  return devGpioShiftProcess( (struct dbCommon *)prec );
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of int64in records
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_shiftInt64in( struct int64inRecord *prec ) {
+  devGpio_shift_t *pshift = (devGpio_shift_t *)((devGpio_info_t *)prec->dpvt)->ext;
+  bool done = prec->pact;
+  long status = devGpioShiftProcess( (struct dbCommon *)prec );
+  if( done && OK == status ) prec->val = (epicsInt64)shiftUnpack( pshift );
+  return status;
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Write routine of int64out records
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioWrite_shiftInt64out( struct int64outRecord *prec ) {
+  devGpio_shift_t *pshift = (devGpio_shift_t *)((devGpio_info_t *)prec->dpvt)->ext;
+  if( !prec->pact ) shiftPack( pshift, (epicsUInt64)prec->val );
+  return devGpioShiftProcess( (struct dbCommon *)prec );
+}
+
+/**-----------------------------------------------------------------------------
+ * @brief   Read routine of waveform records
+ *
+ * Shifts the bytes of the waveform out, or in with the IN option.
+ *
+ * @param   [in]  prec   Address of the record calling this function
+ *
+ * @return  In case of error return -1, otherwise return 0
+ *----------------------------------------------------------------------------*/
+static long devGpioRead_shiftWf( struct waveformRecord *prec ) {
+  devGpio_shift_t *pshift = (devGpio_shift_t *)((devGpio_info_t *)prec->dpvt)->ext;
+  epicsUInt32 nbytes = ( pshift->nbits + 7 ) / 8;
+  bool done = prec->pact;
+
+  if( !done && !pshift->input ) {
+    epicsUInt32 nord = prec->nord < nbytes ? prec->nord : nbytes;
+    memset( pshift->buffer, 0, nbytes );
+    memcpy( pshift->buffer, prec->bptr, nord );
+  }
+  long status = devGpioShiftProcess( (struct dbCommon *)prec );
+  if( done && OK == status && pshift->input ) {
+    memcpy( prec->bptr, pshift->buffer, nbytes );
+    prec->nord = nbytes;
+  }
+  return status;
+}
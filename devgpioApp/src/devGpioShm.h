@@ -0,0 +1,90 @@
+/*******************************************************************************
+ * Copyright (C) 2015 Florian Feldbauer <feldbaue@kph.uni-mainz.de>
+ *                    - Helmholtz-Institut Mainz
+ *
+ * This file is part of devGpio
+ *
+ * devGpio is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * devGpio is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * version 1.0.0; Aug 13, 2015
+ *
+*******************************************************************************/
+
+#ifndef DEV_GPIO_SHM_LAYOUT_H
+#define DEV_GPIO_SHM_LAYOUT_H
+
+/*_____ I N C L U D E S ______________________________________________________*/
+
+/* ANSI C includes  */
+#include <linux/gpio.h>
+
+/* EPICS includes */
+#include <epicsTypes.h>
+
+/* local includes */
+
+/*_____ D E F I N I T I O N S ________________________________________________*/
+
+/* Magic at the start of the segment */
+#define GPIO_SHM_MAGIC        "GPIOSHM1"
+
+/**
+ * @brief Header of the shared-memory segment
+ *
+ * Followed by capacity entries of entrySize bytes.
+ */
+typedef struct GpioShmHeader {
+  char magic[8];            /**< GPIO_SHM_MAGIC, not terminated */
+  epicsUInt32 entrySize;    /**< Size of a single entry */
+  epicsUInt32 capacity;     /**< Number of entries in the segment */
+  epicsUInt32 used;         /**< Number of valid entries, set at iocInit */
+  epicsUInt32 reserved;
+} __attribute__(( aligned( 64 ) )) GpioShmHeader;
+
+/**
+ * @brief State of a single line request
+ *
+ * Entries are protected by a sequence lock, use gpioShmRead() to copy one.
+ * Timestamps are CLOCK_MONOTONIC, like the kernel timestamps of edge events.
+ */
+typedef struct GpioShmEntry {
+  epicsUInt32 seq;          /**< Odd while the entry is written */
+  epicsUInt32 nlines;       /**< Number of requested lines */
+  char name[64];            /**< Record owning the line request */
+  epicsUInt64 levels;       /**< Last known levels, bit N is the N-th line */
+  epicsUInt64 nevents;      /**< Number of edge events read */
+  epicsUInt64 event_ns;     /**< Kernel timestamp of the last edge event */
+  epicsUInt64 update_ns;    /**< Time of the last update */
+  epicsUInt32 offsets[GPIO_V2_LINES_MAX]; /**< Offsets of the requested lines */
+} __attribute__(( aligned( 64 ) )) GpioShmEntry;
+
+/**
+ * @brief Consistent copy of an entry
+ *
+ * Copies the entry while seq is even and unchanged before and after the copy.
+ *
+ * @param   [in]  pentry  Address of the entry in the segment
+ * @param   [out] pcopy   Address of the copy
+ */
+static inline void gpioShmRead( GpioShmEntry const *pentry, GpioShmEntry *pcopy ) {
+  epicsUInt32 seq;
+  do {
+    while( ( seq = __atomic_load_n( &pentry->seq, __ATOMIC_ACQUIRE ) ) & 1u );
+    *pcopy = *pentry;
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+  } while( seq != __atomic_load_n( &pentry->seq, __ATOMIC_RELAXED ) );
+}
+
+#endif